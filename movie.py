@@ -11,7 +11,8 @@ for k in range(NUM_STEPS):
     box = (554, 1450, 1997, 2263)
     if input_image.mode != "RGB":
         input_image = input_image.convert("RGB")
-    if input_image.size != (1997-554, 2263-1450):
+    # jgraph's 300dpi pages need cropping, native frames from rayt -o png don't
+    if input_image.size[0] > 1997-554:
         input_image = input_image.crop(box)
     images.append(input_image)
 
@@ -5,6 +5,15 @@
 #include <string.h>
 #include <math.h>
 #include "args.h"
+#include "topo.h"
+
+
+// options with only a long form, numbered past any character
+enum {RESUME = 256};
+static const struct option LONG_OPTS[] = {
+    {"resume", no_argument, NULL, RESUME},
+    {NULL, 0, NULL, 0}
+};
 
 
 int free_args(KerrArgs *args) {
@@ -18,7 +27,7 @@ int free_args(KerrArgs *args) {
 static void print_usage() {
     fprintf(
         stderr,
-        "Usage: bin/kerr [schwarz|sphere]\n"
+        "Usage: bin/kerr [schwarz|kerr|sphere|bench]\n"
         "Flags:\n"
         "\ta/x: %35s\n"
         "\tb/y: %35s\n"
@@ -29,7 +38,29 @@ static void print_usage() {
         "\tf:   %35s\n"
         "\tq:   %35s\n"
         "\ts:   %35s\n"
-        "\tn:   %35s\n",
+        "\tg:   %35s\n"
+        "\tr:   %35s\n"
+        "\tn:   %35s\n"
+        "\tB:   %35s\n"
+        "\ti:   %35s\n"
+        "\te:   %35s\n"
+        "\tl:   %35s\n"
+        "\tp:   %35s\n"
+        "\tk:   %35s\n"
+        "\tE:   %35s\n"
+        "\tA:   %35s\n"
+        "\td:   %35s\n"
+        "\to:   %35s\n"
+        "\tm:   %35s\n"
+        "\tD:   %35s\n"
+        "\tL:   %35s\n"
+        "\tJ:   %35s\n"
+        "\tC:   %35s\n"
+        "\tW:   %35s\n"
+        "\tP:   %35s\n"
+        "\tT:   %35s\n"
+        "\t--resume %31s\n"
+        "\tj:   %35s\n",
         "x for start/ending pos of camera",
         "y for start/ending pos of camera",
         "z for start/ending pos of camera",
@@ -39,12 +70,38 @@ static void print_usage() {
         "camera fov",
         "number of steps in GIF",
         "task size",
-        "number of threads"
+        "tile size WxH (0 = strips)",
+        "tile order (row|morton|hilbert)",
+        "number of threads (0 = auto)",
+        "pin threads (none|core|node)",
+        "integrator (euler|rk4|rk45|leapfrog)",
+        "integrator error tolerance",
+        "trajectory table angles (0 = off)",
+        "SIMD packet (0|8|16, -1 = auto)",
+        "refine threshold (-1 = off)",
+        "escape radius (0 = off)",
+        "kerr spin a/M (0 to <1)",
+        "frames in flight (0 = auto)",
+        "format (jgr|tga|ppm|png|gif|none)",
+        "jgr merging (0 none|1 spans|2 rects)",
+        "gif frame delay (1/100 s)",
+        "gif repeats (0 = forever, -1 = none)",
+        "jgraph conversion jobs (0 = off)",
+        "coordinate on unix:PATH|HOST:PORT",
+        "work for the coordinator at ADDR",
+        "preview passes (0 = off, max 9)",
+        "preview time limit in s (0 = none)",
+        "skip frames data/manifest lists",
+        "report format (text|json)"
     ); 
 }
 
 
 static void print_args(KerrArgs *args) {
+    char tiles[64] = "off";
+    char depth[16] = "auto";
+    if (args->queueDepth) snprintf(depth, sizeof(depth), "%d", args->queueDepth);
+    if (args->tileWidth) snprintf(tiles, sizeof(tiles), "%d x %d, %s order", args->tileWidth, args->tileHeight, args->tileOrder);
     printf(
         "Start Position: {%.2f, %.2f, %.2f}\n"
         "End Position: {%.2f, %.2f, %.2f}\n"
@@ -52,7 +109,20 @@ static void print_args(KerrArgs *args) {
         "FOV: %.2f\n"
         "Image Size: %d x %d\n"
         "Pixels per Task: %d\n"
-        "Number of Threads: %d\n"
+        "Tiles: %s\n"
+        "Number of Threads: %d%s, pinned to %s\n"
+        "Integrator: %s (tolerance %g)\n"
+        "Trajectory Table: %d angles\n"
+        "Packet Width: %d\n"
+        "Refine Threshold: %d\n"
+        "Escape Radius: %.1f\n"
+        "Spin: %.3f\n"
+        "Frames in Flight: %s\n"
+        "Output Format: %s\n"
+        "JGR Merging: %d\n"
+        "GIF Delay: %d/100 s, Repeats: %d\n"
+        "Conversion Jobs: %d\n"
+        "Report Format: %s\n"
         "Scene: %s\n",
         args->pos0[0], args->pos0[1], args->pos0[2],
         args->pos1[0], args->pos1[1], args->pos1[2],
@@ -60,7 +130,20 @@ static void print_args(KerrArgs *args) {
         args->fov,
         args->width, args->height,
         args->taskSize,
-        args->numThreads,
+        tiles,
+        args->numThreads, args->autoThreads ? " (auto)" : "", args->bind,
+        args->integrator, args->tol,
+        args->tableSize,
+        args->packetWidth,
+        args->refine,
+        args->escape,
+        args->spin,
+        depth,
+        args->format,
+        args->merge,
+        args->delay, args->loop,
+        args->convertJobs,
+        args->report,
         args->scene
     );
 }
@@ -75,11 +158,36 @@ KerrArgs *parse_args(int argc, char **argv) {
         {0, 0, 1},
         90,         // fov
         30,         // num steps
+        0,          // current step
         96,         // width
         54,         // height
         2048,       // task size
+        0,          // tile width
+        0,          // tile height
+        "row",      // tile order
         NULL,       // file name
-        16,         // num threads
+        0,          // num threads, 0 for one per usable cpu
+        "none",     // thread pinning
+        false,      // threads picked automatically
+        "euler",    // integrator
+        1e-5,       // tolerance
+        0,          // table size
+        -1,         // packet width
+        -1,         // refine threshold
+        6,          // escape radius
+        .9,         // spin
+        0,          // queue depth
+        "jgr",      // output format
+        0,          // jgr merging
+        2,          // gif frame delay
+        0,          // gif repeats
+        0,          // conversion jobs
+        NULL,       // address to coordinate workers on
+        NULL,       // coordinator to work for
+        false,      // resume from the manifest
+        0,          // preview passes
+        0,          // preview time limit
+        "text",     // report format
         "schwarz"   // scene
     };
 
@@ -90,15 +198,17 @@ KerrArgs *parse_args(int argc, char **argv) {
         return NULL;
     } else {
         out->scene = argv[1];
-        if (strcmp(out->scene, "schwarz") && strcmp(out->scene, "sphere")) {
-            fprintf(stderr, "Error: invalid scene \"%s\" name is neither \"schwarz\" nor \"sphere\"\n", out->scene);
+        if (strcmp(out->scene, "schwarz") && strcmp(out->scene, "kerr") && strcmp(out->scene, "sphere") && strcmp(out->scene, "bench")) {
+            fprintf(stderr, "Error: invalid scene \"%s\" is not one of schwarz, kerr, sphere or bench\n", out->scene);
             free(out);
             return NULL;
         }
     }
 
+    // start over should this not be the first command line parsed
     int opt;
-    while((opt = getopt(argc - 1, argv + 1, "a:b:c:x:t:y:u:z:v:f:q:s:n:")) != -1)  
+    optind = 1;
+    while((opt = getopt_long(argc - 1, argv + 1, "a:b:c:x:t:y:u:z:v:f:q:s:g:r:n:i:e:l:p:k:E:A:d:o:m:D:L:J:j:B:C:W:P:T:", LONG_OPTS, NULL)) != -1)  
     {  
         switch(opt)  
         {
@@ -203,12 +313,257 @@ KerrArgs *parse_args(int argc, char **argv) {
                 }
                 break;
 
+            case 'g':
+                if (!strcmp(optarg, "0")) {
+                    out->tileWidth = out->tileHeight = 0;
+                } else if (sscanf(optarg, "%dx%d", &(out->tileWidth), &(out->tileHeight)) != 2) {
+                    fprintf(stderr, "Error: failed to convert tile size to WxH\n");
+                    free_args(out);
+                    return NULL;
+                } else if (out->tileWidth <= 0 || out->tileHeight <= 0) {
+                    fprintf(stderr, "Error: invalid tile size\n");
+                    free_args(out);
+                    return NULL;
+                }
+                break;
+
+            case 'r':
+                out->tileOrder = optarg;
+                if (strcmp(out->tileOrder, "row") && strcmp(out->tileOrder, "morton") && strcmp(out->tileOrder, "hilbert")) {
+                    fprintf(stderr, "Error: invalid tile order \"%s\" is not one of row, morton or hilbert\n", out->tileOrder);
+                    free_args(out);
+                    return NULL;
+                }
+                break;
+
             case 'n':  
                 if (sscanf(optarg, "%d", &(out->numThreads)) != 1) {
                     fprintf(stderr, "Error: failed to convert number of threads to an integer\n");
                     free_args(out);
                     return NULL;
                 }
+                if (out->numThreads < 0) {
+                    fprintf(stderr, "Error: invalid number of threads\n");
+                    free_args(out);
+                    return NULL;
+                }
+                break;
+
+            case 'B':
+                out->bind = optarg;
+                if (strcmp(out->bind, "none") && strcmp(out->bind, "core") && strcmp(out->bind, "node")) {
+                    fprintf(stderr, "Error: invalid thread pinning \"%s\" is not one of none, core or node\n", out->bind);
+                    free_args(out);
+                    return NULL;
+                }
+                break;
+
+            case 'i':
+                out->integrator = optarg;
+                if (strcmp(out->integrator, "euler") && strcmp(out->integrator, "rk4") && strcmp(out->integrator, "rk45") && strcmp(out->integrator, "leapfrog")) {
+                    fprintf(stderr, "Error: invalid integrator \"%s\" is not one of euler, rk4, rk45 or leapfrog\n", out->integrator);
+                    free_args(out);
+                    return NULL;
+                }
+                break;
+
+            case 'e':
+                if (sscanf(optarg, "%f", &(out->tol)) != 1) {
+                    fprintf(stderr, "Error: failed to convert tolerance to a float\n");
+                    free_args(out);
+                    return NULL;
+                }
+                if (out->tol <= 0.0F) {
+                    fprintf(stderr, "Error: invalid tolerance\n");
+                    free_args(out);
+                    return NULL;
+                }
+                break;
+
+            case 'l':
+                if (sscanf(optarg, "%d", &(out->tableSize)) != 1) {
+                    fprintf(stderr, "Error: failed to convert table size to an integer\n");
+                    free_args(out);
+                    return NULL;
+                }
+                if (out->tableSize == 1 || out->tableSize < 0) {
+                    fprintf(stderr, "Error: invalid table size, needs at least 2 angles\n");
+                    free_args(out);
+                    return NULL;
+                }
+                break;
+
+            case 'p':
+                if (sscanf(optarg, "%d", &(out->packetWidth)) != 1) {
+                    fprintf(stderr, "Error: failed to convert packet width to an integer\n");
+                    free_args(out);
+                    return NULL;
+                }
+                if (out->packetWidth != -1 && out->packetWidth != 0 && out->packetWidth != 8 && out->packetWidth != 16) {
+                    fprintf(stderr, "Error: invalid packet width, must be 0, 8, 16 or -1\n");
+                    free_args(out);
+                    return NULL;
+                }
+                break;
+
+            case 'k':
+                if (sscanf(optarg, "%d", &(out->refine)) != 1) {
+                    fprintf(stderr, "Error: failed to convert refine threshold to an integer\n");
+                    free_args(out);
+                    return NULL;
+                }
+                if (out->refine < -1 || out->refine > 255) {
+                    fprintf(stderr, "Error: invalid refine threshold, must be -1 to 255\n");
+                    free_args(out);
+                    return NULL;
+                }
+                break;
+
+            case 'E':
+                if (sscanf(optarg, "%f", &(out->escape)) != 1) {
+                    fprintf(stderr, "Error: failed to convert escape radius to a float\n");
+                    free_args(out);
+                    return NULL;
+                }
+                if (out->escape && out->escape < 6.0F) {
+                    fprintf(stderr, "Error: invalid escape radius, must be 0 or outside the disk (at least 6)\n");
+                    free_args(out);
+                    return NULL;
+                }
+                break;
+
+            case 'A':
+                if (sscanf(optarg, "%f", &(out->spin)) != 1) {
+                    fprintf(stderr, "Error: failed to convert spin to a float\n");
+                    free_args(out);
+                    return NULL;
+                }
+                if (out->spin < 0.0F || out->spin >= 1.0F) {
+                    fprintf(stderr, "Error: invalid spin, must be at least 0 and below 1\n");
+                    free_args(out);
+                    return NULL;
+                }
+                break;
+
+            case 'd':
+                if (sscanf(optarg, "%d", &(out->queueDepth)) != 1) {
+                    fprintf(stderr, "Error: failed to convert queue depth to an integer\n");
+                    free_args(out);
+                    return NULL;
+                }
+                if (out->queueDepth < 0) {
+                    fprintf(stderr, "Error: invalid queue depth\n");
+                    free_args(out);
+                    return NULL;
+                }
+                break;
+
+            case 'o':
+                out->format = optarg;
+                if (strcmp(out->format, "jgr") && strcmp(out->format, "tga") && strcmp(out->format, "ppm") && strcmp(out->format, "png") && strcmp(out->format, "gif") && strcmp(out->format, "none")) {
+                    fprintf(stderr, "Error: invalid output format \"%s\" is not one of jgr, tga, ppm, png, gif or none\n", out->format);
+                    free_args(out);
+                    return NULL;
+                }
+                break;
+
+            case 'm':
+                if (sscanf(optarg, "%d", &(out->merge)) != 1) {
+                    fprintf(stderr, "Error: failed to convert jgr merging to an integer\n");
+                    free_args(out);
+                    return NULL;
+                }
+                if (out->merge < 0 || out->merge > 2) {
+                    fprintf(stderr, "Error: invalid jgr merging, must be 0, 1 or 2\n");
+                    free_args(out);
+                    return NULL;
+                }
+                break;
+
+            case 'D':
+                if (sscanf(optarg, "%d", &(out->delay)) != 1) {
+                    fprintf(stderr, "Error: failed to convert gif frame delay to an integer\n");
+                    free_args(out);
+                    return NULL;
+                }
+                if (out->delay < 0 || out->delay > 65535) {
+                    fprintf(stderr, "Error: invalid gif frame delay, must be 0 to 65535 hundredths of a second\n");
+                    free_args(out);
+                    return NULL;
+                }
+                break;
+
+            case 'L':
+                if (sscanf(optarg, "%d", &(out->loop)) != 1) {
+                    fprintf(stderr, "Error: failed to convert gif repeats to an integer\n");
+                    free_args(out);
+                    return NULL;
+                }
+                if (out->loop < -1 || out->loop > 65535) {
+                    fprintf(stderr, "Error: invalid gif repeats, must be -1 to 65535\n");
+                    free_args(out);
+                    return NULL;
+                }
+                break;
+
+            case 'J':
+                if (sscanf(optarg, "%d", &(out->convertJobs)) != 1) {
+                    fprintf(stderr, "Error: failed to convert conversion jobs to an integer\n");
+                    free_args(out);
+                    return NULL;
+                }
+                if (out->convertJobs < 0) {
+                    fprintf(stderr, "Error: invalid number of conversion jobs\n");
+                    free_args(out);
+                    return NULL;
+                }
+                break;
+
+            case 'C':
+                out->coordinate = optarg;
+                break;
+
+            case 'W':
+                out->workFor = optarg;
+                break;
+
+            case 'P':
+                if (sscanf(optarg, "%d", &(out->passes)) != 1) {
+                    fprintf(stderr, "Error: failed to convert preview passes to an integer\n");
+                    free_args(out);
+                    return NULL;
+                }
+                if (out->passes < 0) {
+                    fprintf(stderr, "Error: invalid number of preview passes\n");
+                    free_args(out);
+                    return NULL;
+                }
+                break;
+
+            case 'T':
+                if (sscanf(optarg, "%f", &(out->passTime)) != 1) {
+                    fprintf(stderr, "Error: failed to convert preview time limit to a float\n");
+                    free_args(out);
+                    return NULL;
+                }
+                if (out->passTime < 0) {
+                    fprintf(stderr, "Error: invalid preview time limit\n");
+                    free_args(out);
+                    return NULL;
+                }
+                break;
+
+            case RESUME:
+                out->resume = true;
+                break;
+
+            case 'j':
+                out->report = optarg;
+                if (strcmp(out->report, "text") && strcmp(out->report, "json")) {
+                    fprintf(stderr, "Error: invalid report format \"%s\" is neither text nor json\n", out->report);
+                    free_args(out);
+                    return NULL;
+                }
                 break;
 
             case '?':  
@@ -218,10 +573,39 @@ KerrArgs *parse_args(int argc, char **argv) {
         }  
     }
 
+    // one thread per cpu the process may use, within its cgroup's quota
+    if (!out->numThreads) {
+        Topology topo;
+        topo_detect(&topo, "", NULL, 0);
+        out->numThreads = topo_threads(&topo);
+        out->autoThreads = true;
+    }
+
+    // a process either hands tiles out or renders them, and conversions
+    // hang off the local pool's writer
+    if (out->coordinate && out->workFor) {
+        fprintf(stderr, "Error: a process can't both coordinate and work\n");
+        free_args(out);
+        return NULL;
+    }
+    if (out->coordinate && out->convertJobs) {
+        fprintf(stderr, "Error: conversion jobs need a local render\n");
+        free_args(out);
+        return NULL;
+    }
+
+    // only jgraph files have anything to convert
+    if (out->convertJobs && strcmp(out->format, "jgr")) {
+        fprintf(stderr, "Error: conversion jobs need jgr output\n");
+        free_args(out);
+        return NULL;
+    }
+
     // normalize direction vector
     float dirlen = sqrt(out->dir[0] * out->dir[0] + out->dir[1] * out->dir[1] + out->dir[2] * out->dir[2]);
     if (dirlen > .001) for (int i = 0; i < 3; ++i) out->dir[i] /= dirlen;
 
-    print_args(out);
+    // JSON reports go to stdout on their own, keep it clean
+    if (strcmp(out->scene, "bench") && strcmp(out->report, "json")) print_args(out);
     return out;
 }
\ No newline at end of file
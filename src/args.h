@@ -1,6 +1,8 @@
 #ifndef ARGS_H
 #define ARGS_H
 
+#include <stdbool.h>
+
 /*
 x/t : x pos/dir of camera
 y/u : y pos/dir of camera
@@ -8,9 +10,30 @@ z/v : z pos/dir of camera
 f : camera fov
 w : width of picture
 h : height of picture
-s : task size
-m : file name of image
-n : number of threads
+s : task size (pixels per strip when tiles are off)
+g : tile size as WxH (0 for linear strips of s pixels)
+r : tile order (row, morton or hilbert)
+n : number of threads (0 for every usable cpu, within the cgroup cpu quota)
+B : thread pinning (none, core to give each worker a cpu, node to keep each worker on its numa node)
+d : number of frames in flight, rendering or queued for the writer (0 picks enough to keep every thread busy)
+o : output format (jgr, tga, ppm, png, gif for one animated video.gif, or none to discard frames)
+m : jgr merging (0 per pixel, 1 row spans, 2 rectangles)
+D : gif frame delay in hundredths of a second
+L : times the gif repeats (0 forever, -1 plays once)
+J : jgraph | ps2pdf | convert pipelines run at once on finished frames (0 leaves them to video.sh)
+C : address to hand tiles out to worker processes on, unix:PATH or HOST:PORT, instead of rendering locally
+W : address of a coordinator to render tiles for, with its settings; only -n and -B are the worker's own
+P : progressive preview of the start position in up to this many passes, each tracing twice the pixels (0 renders the animation)
+T : seconds after which a progressive preview stops at the end of its current pass (0 for no limit)
+--resume : skip the frames data/manifest says a run with the same settings already wrote
+i : geodesic integrator (euler, rk4, rk45 or leapfrog)
+e : integrator error tolerance
+l : emission angles in the trajectory table (0 to trace every pixel)
+E : escape radius, outbound photons past it are continued analytically (0 integrates them all the way)
+A : spin of the kerr scene's hole as a / M, from 0 (schwarzschild) up to but not including 1
+k : colour difference between coarse samples that gets traced in full (-1 traces every pixel)
+j : end of run report format (text or json)
+p : rays per SIMD packet (0 scalar, 8 AVX2, 16 AVX-512, -1 widest available)
 */
 
 
@@ -21,11 +44,36 @@ typedef struct KerrArgs {
     float dir[3];
     float fov;
     int num_steps;
+    int step; // frame the current position is for
     int width;
     int height;
     int taskSize;
+    int tileWidth;
+    int tileHeight;
+    char *tileOrder;
     char *fileName;
     int numThreads;
+    char *bind;
+    bool autoThreads;
+    char *integrator;
+    float tol;
+    int tableSize;
+    int packetWidth;
+    int refine;
+    float escape;
+    float spin;
+    int queueDepth;
+    char *format;
+    int merge;
+    int delay;
+    int loop;
+    int convertJobs;
+    char *coordinate;
+    char *workFor;
+    bool resume;
+    int passes;
+    float passTime;
+    char *report;
     char *scene;
 } KerrArgs;
 
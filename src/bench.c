@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include "args.h"
+#include "render.h"
+#include "tpool.h"
+#include "packet.h"
+#include "bench.h"
+
+#define BENCH_FRAMES 8 // frames along each reference camera path
+
+
+// a reference camera path rendered at a fixed resolution
+typedef struct BenchCase {
+    const char *name;
+    const char *scene;
+    float pos0[3];
+    float pos1[3];
+    float dir[3];
+    int width;
+    int height;
+} BenchCase;
+
+
+static const BenchCase CASES[] = {
+    {"pierce", "schwarz", {1.1, .1, -8}, {1.1, .1, -3}, {0, 0, 1}, 96, 54},
+    {"pierce-large", "schwarz", {1.1, .1, -8}, {1.1, .1, -3}, {0, 0, 1}, 384, 216},
+    {"slide", "schwarz", {-5, .5, 8}, {5, .5, 8}, {0, 0, -1}, 192, 108},
+    {"kerr", "kerr", {1.1, .1, -8}, {1.1, .1, -3}, {0, 0, 1}, 96, 54},
+    {"sphere", "sphere", {1.1, .1, -8}, {1.1, .1, -3}, {0, 0, 1}, 192, 108}
+};
+#define NUM_CASES (int) (sizeof(CASES) / sizeof(CASES[0]))
+#define SCALING_CASE 1 // the case rendered again at every thread count
+
+
+// renders a case's camera path with the user's render settings, discarding the frames
+static void run_case(KerrArgs *args, const BenchCase *bc, int numThreads, PoolStats *stats) {
+    KerrArgs run = *args;
+    run.scene = (char *) bc->scene;
+    run.width = bc->width;
+    run.height = bc->height;
+    run.num_steps = BENCH_FRAMES;
+    run.numThreads = numThreads;
+    run.format = "none";
+    run.fileName = NULL;
+    for (int j = 0; j < 3; ++j) run.dir[j] = bc->dir[j];
+
+    for (int j = 0; j < 3; ++j) run.pos[j] = bc->pos0[j];
+    TPool *pool = tpool_init(&run);
+    for (int i = 0; i < BENCH_FRAMES; ++i) {
+        for (int j = 0; j < 3; ++j) run.pos[j] = bc->pos0[j] + (bc->pos1[j] - bc->pos0[j]) * i / (BENCH_FRAMES - 1);
+        tpool_submit(pool, &run, "bench");
+    }
+    tpool_close(pool, stats);
+}
+
+
+static int cmp_double(const void *a, const void *b) {
+    double da = *(const double *) a;
+    double db = *(const double *) b;
+    return (da > db) - (da < db);
+}
+
+
+// nearest rank percentile of a sorted list
+static double percentile(double *sorted, long n, double p) {
+    if (!n) return 0.0;
+    long rank = (long) (p / 100.0 * n + .999999);
+    if (rank < 1) rank = 1;
+    return sorted[rank - 1];
+}
+
+
+int bench_run(KerrArgs *args) {
+    char tiles[64] = "strips";
+    if (args->tileWidth) snprintf(tiles, sizeof(tiles), "%dx%d %s", args->tileWidth, args->tileHeight, args->tileOrder);
+
+    printf("{\n");
+    printf(
+        "  \"config\": {\"integrator\": \"%s\", \"tolerance\": %g, \"table\": %d, \"packet_width\": %d, "
+        "\"simd_width\": %d, \"refine\": %d, \"spin\": %g, \"tiles\": \"%s\", \"task_size\": %d, \"threads\": %d, \"pinning\": \"%s\", \"frames\": %d},\n",
+        args->integrator, args->tol, args->tableSize, args->packetWidth,
+        packet_width(), args->refine, args->spin, tiles, args->taskSize, args->numThreads, args->bind, BENCH_FRAMES
+    );
+
+    // every reference case at the full thread count
+    printf("  \"cases\": [\n");
+    for (int c = 0; c < NUM_CASES; ++c) {
+        PoolStats stats;
+        run_case(args, CASES + c, args->numThreads, &stats);
+        qsort(stats.latency, stats.numLatency, sizeof(double), cmp_double);
+        printf(
+            "    {\"name\": \"%s\", \"scene\": \"%s\", \"width\": %d, \"height\": %d, \"seconds\": %.4f, "
+            "\"rays_per_sec\": %.0f, \"steps_per_sec\": %.0f, \"steps_per_ray\": %.1f, "
+            "\"fates\": {\"escaped\": %ld, \"horizon\": %ld, \"disk\": %ld}, "
+            "\"latency_ms\": {\"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f}}%s\n",
+            CASES[c].name, CASES[c].scene, CASES[c].width, CASES[c].height, stats.seconds,
+            stats.rays / stats.seconds, (stats.steps + stats.tableSteps) / stats.seconds,
+            stats.rays ? stats.steps / (double) stats.rays : 0.0,
+            stats.fates[ESCAPED], stats.fates[HORIZON], stats.fates[DISK],
+            1e3 * percentile(stats.latency, stats.numLatency, 50), 1e3 * percentile(stats.latency, stats.numLatency, 90),
+            1e3 * percentile(stats.latency, stats.numLatency, 99), 1e3 * percentile(stats.latency, stats.numLatency, 100),
+            c == NUM_CASES - 1 ? "" : ","
+        );
+        free(stats.latency);
+    }
+    printf("  ],\n");
+
+    // one case again at 1, 2, 4, ... threads and the full count
+    printf("  \"scaling\": {\"case\": \"%s\", \"runs\": [\n", CASES[SCALING_CASE].name);
+    double base = 0.0;
+    for (int n = 1; n <= args->numThreads; n = n * 2 > args->numThreads && n < args->numThreads ? args->numThreads : n * 2) {
+        PoolStats stats;
+        run_case(args, CASES + SCALING_CASE, n, &stats);
+        free(stats.latency);
+        double rate = stats.rays / stats.seconds;
+        if (n == 1) base = rate;
+        printf(
+            "    {\"threads\": %d, \"groups\": %d, \"rays_per_sec\": %.0f, \"speedup\": %.2f, \"efficiency\": %.2f}%s\n",
+            n, stats.numGroups, rate, rate / base, rate / base / n, n == args->numThreads ? "" : ","
+        );
+    }
+    printf("  ]},\n");
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("  \"peak_rss_kb\": %ld\n", usage.ru_maxrss);
+    printf("}\n");
+    return 0;
+}
@@ -0,0 +1,11 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+
+#include "args.h"
+
+
+int bench_run(KerrArgs *args);
+
+
+#endif
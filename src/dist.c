@@ -0,0 +1,563 @@
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "args.h"
+#include "render.h"
+#include "tga.h"
+#include "manifest.h"
+#include "topo.h"
+#include "dist.h"
+
+#define DIST_DEPTH 8 // frames in flight unless -d says otherwise
+#define DIST_AHEAD 2 // tiles a worker holds at once, so it never waits on a round trip
+#define DIST_TILE 32 // tile size when refining without -g
+#define DIST_TRIES 100 // attempts a worker makes to reach the coordinator, DIST_RETRY_MS apart
+#define DIST_RETRY_MS 100
+
+
+// a rectangle of the frame, handed out whole
+typedef struct Unit {
+    int x0, y0, w, h;
+} Unit;
+
+
+// one frame in flight, assembled in place as its tiles come back
+typedef struct Slot {
+    float pos[3];
+    char fileName[256];
+    int step;
+    Pixel *pixels;
+    int left;
+} Slot;
+
+
+// a tile of a frame, as handed out or waiting to be handed out again
+typedef struct Held {
+    long frame;
+    int unit;
+} Held;
+
+
+// a connected worker and the tiles it owes, oldest first; fd is -1 once it's gone
+typedef struct Conn {
+    int fd;
+    Held held[DIST_AHEAD];
+    int numHeld;
+    long tiles;
+} Conn;
+
+
+struct Dist {
+    int fd;
+    char unixPath[108]; // removed again on close
+    int width;
+    int height;
+    Unit *units;
+    int numUnits;
+    Slot *slots;
+    int depth;
+    long posted;
+    long written;
+    long nextFrame; // the next tile never handed out yet
+    int nextUnit;
+    Held *retry; // tiles whose worker went away, handed out before anything new
+    int numRetry;
+    Conn *conns;
+    int numConns;
+    int capConns;
+    ImgWriter save;
+    ImgOpts opts;
+    Manifest *manifest;
+    DistHello hello;
+    char *argv; // the coordinator's argv as the hello carries it
+    bool json;
+    DistStats stats;
+    double started;
+};
+
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static bool send_all(int fd, const void *buf, size_t len) {
+    // a worker that went away is noticed here, not by SIGPIPE
+    const char *cur = buf;
+    while (len) {
+        ssize_t n = send(fd, cur, len, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        cur += n;
+        len -= n;
+    }
+    return true;
+}
+
+
+static bool recv_all(int fd, void *buf, size_t len) {
+    char *cur = buf;
+    while (len) {
+        ssize_t n = recv(fd, cur, len, 0);
+        if (n <= 0) return false;
+        cur += n;
+        len -= n;
+    }
+    return true;
+}
+
+
+// opens a stream socket for "unix:PATH" or "HOST:PORT", listening on it
+// when serving and connected to it otherwise; -1 if that didn't work
+static int dist_socket(const char *addr, bool serve) {
+    if (!strncmp(addr, "unix:", 5)) {
+        struct sockaddr_un sa = {.sun_family = AF_UNIX};
+        if (strlen(addr + 5) >= sizeof(sa.sun_path)) return -1;
+        strcpy(sa.sun_path, addr + 5);
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        if (serve) unlink(sa.sun_path);
+        bool ok = serve ? !bind(fd, (struct sockaddr *) &sa, sizeof(sa)) && !listen(fd, SOMAXCONN) : !connect(fd, (struct sockaddr *) &sa, sizeof(sa));
+        if (!ok) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    const char *colon = strrchr(addr, ':');
+    if (!colon) return -1;
+    char host[256];
+    snprintf(host, sizeof(host), "%.*s", (int) (colon - addr), addr);
+    struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM, .ai_flags = serve ? AI_PASSIVE : 0};
+    struct addrinfo *res;
+    if (getaddrinfo(*host ? host : NULL, colon + 1, &hints, &res)) return -1;
+    int fd = -1;
+    for (struct addrinfo *ai = res; ai && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) continue;
+        int one = 1;
+        if (serve) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        else setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        bool ok = serve ? !bind(fd, ai->ai_addr, ai->ai_addrlen) && !listen(fd, SOMAXCONN) : !connect(fd, ai->ai_addr, ai->ai_addrlen);
+        if (!ok) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+
+// the same tiles the pool would render where refining needs them, and
+// otherwise bands of whole rows about taskSize pixels each
+static int make_units(Dist *dist, KerrArgs *args) {
+    int tileWidth = args->tileWidth, tileHeight = args->tileHeight;
+    if (!tileWidth && args->refine >= 0) tileWidth = tileHeight = DIST_TILE;
+    if (!tileWidth) {
+        tileWidth = args->width;
+        tileHeight = args->taskSize / args->width > 1 ? args->taskSize / args->width : 1;
+    }
+    int cols = (args->width + tileWidth - 1) / tileWidth;
+    int rows = (args->height + tileHeight - 1) / tileHeight;
+    dist->units = malloc(cols * rows * sizeof(Unit));
+    for (int ty = 0; ty < rows; ++ty) {
+        for (int tx = 0; tx < cols; ++tx) {
+            Unit *unit = dist->units + ty * cols + tx;
+            unit->x0 = tx * tileWidth;
+            unit->y0 = ty * tileHeight;
+            unit->w = args->width - unit->x0 < tileWidth ? args->width - unit->x0 : tileWidth;
+            unit->h = args->height - unit->y0 < tileHeight ? args->height - unit->y0 : tileHeight;
+        }
+    }
+    return cols * rows;
+}
+
+
+Dist *dist_init(KerrArgs *args, const char *addr, int argc, char **argv) {
+    int fd = dist_socket(addr, true);
+    if (fd < 0) {
+        fprintf(stderr, "Error: failed to listen on \"%s\"\n", addr);
+        return NULL;
+    }
+    Dist *dist = malloc(sizeof(Dist));
+    dist->fd = fd;
+    snprintf(dist->unixPath, sizeof(dist->unixPath), "%s", strncmp(addr, "unix:", 5) ? "" : addr + 5);
+    dist->width = args->width;
+    dist->height = args->height;
+    dist->numUnits = make_units(dist, args);
+    dist->depth = args->queueDepth ? args->queueDepth : DIST_DEPTH;
+    if (dist->depth > args->num_steps) dist->depth = args->num_steps;
+    if (dist->depth < 1) dist->depth = 1;
+    dist->slots = malloc(dist->depth * sizeof(Slot));
+    for (int i = 0; i < dist->depth; ++i) dist->slots[i].pixels = malloc(args->width * args->height * sizeof(Pixel));
+    dist->posted = 0;
+    dist->written = 0;
+    dist->nextFrame = 0;
+    dist->nextUnit = 0;
+    dist->retry = malloc(dist->depth * dist->numUnits * sizeof(Held));
+    dist->numRetry = 0;
+    dist->conns = NULL;
+    dist->numConns = 0;
+    dist->capConns = 0;
+    dist->save = img_writer(args->format);
+    dist->opts = (ImgOpts) {args->merge, args->delay, args->loop, 0, 0};
+    dist->manifest = NULL;
+    dist->json = !strcmp(args->report, "json");
+    dist->stats = (DistStats) {0};
+    dist->started = now();
+
+    // the argv every worker parses for itself
+    int len = 0;
+    for (int i = 0; i < argc; ++i) len += strlen(argv[i]) + 1;
+    dist->argv = malloc(len);
+    dist->hello = (DistHello) {DIST_MAGIC, argc, len};
+    len = 0;
+    for (int i = 0; i < argc; ++i) {
+        strcpy(dist->argv + len, argv[i]);
+        len += strlen(argv[i]) + 1;
+    }
+    return dist;
+}
+
+
+// hands out a tile left by a lost worker, or else the next new one
+static bool next_task(Dist *dist, Held *out) {
+    if (dist->numRetry) {
+        *out = dist->retry[--dist->numRetry];
+        return true;
+    }
+    if (dist->nextFrame == dist->posted) return false;
+    *out = (Held) {dist->nextFrame, dist->nextUnit};
+    if (++dist->nextUnit == dist->numUnits) {
+        dist->nextFrame += 1;
+        dist->nextUnit = 0;
+    }
+    return true;
+}
+
+
+// a worker that went away leaves its tiles to the others
+static void drop(Dist *dist, Conn *conn) {
+    for (int i = 0; i < conn->numHeld; ++i) dist->retry[dist->numRetry++] = conn->held[i];
+    if (conn->numHeld) dist->stats.lost += 1;
+    dist->stats.reassigned += conn->numHeld;
+    conn->numHeld = 0;
+    close(conn->fd);
+    conn->fd = -1;
+}
+
+
+static void feed(Dist *dist, Conn *conn) {
+    Held held;
+    while (conn->fd >= 0 && conn->numHeld < DIST_AHEAD && next_task(dist, &held)) {
+        Unit *unit = dist->units + held.unit;
+        Slot *slot = dist->slots + held.frame % dist->depth;
+        DistTask task = {held.frame, held.unit, unit->x0, unit->y0, unit->w, unit->h, {slot->pos[0], slot->pos[1], slot->pos[2]}};
+        conn->held[conn->numHeld++] = held;
+        if (!send_all(conn->fd, &task, sizeof(task))) drop(dist, conn);
+    }
+}
+
+
+static void accept_worker(Dist *dist) {
+    int fd = accept(dist->fd, NULL, NULL);
+    if (fd < 0) return;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (!send_all(fd, &(dist->hello), sizeof(DistHello)) || !send_all(fd, dist->argv, dist->hello.len)) {
+        close(fd);
+        return;
+    }
+    if (dist->numConns == dist->capConns) {
+        dist->capConns = dist->capConns ? 2 * dist->capConns : 8;
+        dist->conns = realloc(dist->conns, dist->capConns * sizeof(Conn));
+    }
+    dist->conns[dist->numConns++] = (Conn) {.fd = fd};
+    dist->stats.workers += 1;
+}
+
+
+// takes a finished tile straight into its frame's image
+static void receive(Dist *dist, Conn *conn) {
+    DistResult res;
+    if (!recv_all(conn->fd, &res, sizeof(res)) || !conn->numHeld || res.frame != conn->held[0].frame || res.unit != conn->held[0].unit) {
+        drop(dist, conn);
+        return;
+    }
+    Unit *unit = dist->units + res.unit;
+    Slot *slot = dist->slots + res.frame % dist->depth;
+    for (int row = 0; row < unit->h; ++row) {
+        if (!recv_all(conn->fd, slot->pixels + (unit->y0 + row) * dist->width + unit->x0, unit->w * sizeof(Pixel))) {
+            drop(dist, conn);
+            return;
+        }
+    }
+    conn->numHeld -= 1;
+    memmove(conn->held, conn->held + 1, conn->numHeld * sizeof(Held));
+    conn->tiles += 1;
+    slot->left -= 1;
+    dist->stats.tiles += 1;
+    dist->stats.rays += res.rays;
+    dist->stats.steps += res.steps;
+}
+
+
+// writes finished frames in order through the format's writer
+static void write_ready(Dist *dist) {
+    while (dist->written < dist->posted && !dist->slots[dist->written % dist->depth].left) {
+        Slot *slot = dist->slots + dist->written % dist->depth;
+        if (!dist->save(slot->fileName, slot->pixels, dist->width, dist->height, &(dist->opts))) {
+            fprintf(stderr, "Error: failed to write \"%s\"\n", slot->fileName);
+        } else if (dist->manifest) {
+            manifest_record(dist->manifest, slot->step, slot->fileName);
+        }
+        dist->written += 1;
+    }
+}
+
+
+// waits up to timeout ms for workers to connect or send tiles back, then
+// writes what's done and tops every worker up
+static void pump(Dist *dist, int timeout) {
+    struct pollfd *fds = malloc((dist->numConns + 1) * sizeof(struct pollfd));
+    int *which = malloc((dist->numConns + 1) * sizeof(int));
+    int numFds = 1;
+    fds[0] = (struct pollfd) {dist->fd, POLLIN, 0};
+    for (int i = 0; i < dist->numConns; ++i) {
+        if (dist->conns[i].fd < 0) continue;
+        which[numFds] = i;
+        fds[numFds++] = (struct pollfd) {dist->conns[i].fd, POLLIN, 0};
+    }
+    if (poll(fds, numFds, timeout) > 0) {
+        for (int i = 1; i < numFds; ++i) {
+            if (fds[i].revents) receive(dist, dist->conns + which[i]);
+        }
+        if (fds[0].revents & POLLIN) accept_worker(dist);
+    }
+    free(fds);
+    free(which);
+
+    write_ready(dist);
+    for (int i = 0; i < dist->numConns; ++i) feed(dist, dist->conns + i);
+}
+
+
+void dist_manifest(Dist *dist, Manifest *manifest) {
+    dist->manifest = manifest;
+    dist->opts.frames = manifest_count(manifest);
+}
+
+
+void dist_submit(Dist *dist, KerrArgs *args, const char *fileName) {
+    // wait for a free slot, i.e. for the oldest frame to be written
+    while (dist->posted - dist->written == dist->depth) pump(dist, -1);
+    Slot *slot = dist->slots + dist->posted % dist->depth;
+    for (int i = 0; i < 3; ++i) slot->pos[i] = args->pos[i];
+    snprintf(slot->fileName, sizeof(slot->fileName), "%s", fileName);
+    slot->step = args->step;
+    slot->left = dist->numUnits;
+    dist->posted += 1;
+    pump(dist, 0);
+}
+
+
+void dist_close(Dist *dist, DistStats *stats) {
+    while (dist->written < dist->posted) pump(dist, -1);
+
+    // let every worker still connected go
+    long tiles[dist->numConns + 1];
+    DistTask done = {-1, 0, 0, 0, 0, 0, {0, 0, 0}};
+    for (int i = 0; i < dist->numConns; ++i) {
+        tiles[i] = dist->conns[i].tiles;
+        if (dist->conns[i].fd < 0) continue;
+        send_all(dist->conns[i].fd, &done, sizeof(done));
+        close(dist->conns[i].fd);
+    }
+    close(dist->fd);
+    if (*dist->unixPath) unlink(dist->unixPath);
+
+    DistStats out = dist->stats;
+    out.frames = dist->written;
+    out.seconds = now() - dist->started;
+    if (stats) {
+        *stats = out;
+    } else if (dist->json) {
+        printf("{\n");
+        printf(
+            "  \"frames\": %ld, \"tiles\": %ld, \"tiles_per_frame\": %d, \"rays\": %ld, \"steps\": %ld, \"seconds\": %.4f,\n",
+            out.frames, out.tiles, dist->numUnits, out.rays, out.steps, out.seconds
+        );
+        printf("  \"workers\": %ld, \"lost\": %ld, \"reassigned\": %ld,\n", out.workers, out.lost, out.reassigned);
+        printf("  \"worker_tiles\": [");
+        for (int i = 0; i < dist->numConns; ++i) printf("%s%ld", i ? ", " : "", tiles[i]);
+        printf("]\n}\n");
+    } else {
+        printf("Average Steps per Ray: %.1f\n", out.rays ? out.steps / (double) out.rays : 0.0);
+        printf("Tiles: %ld rendered (%d per frame), %ld handed out again\n", out.tiles, dist->numUnits, out.reassigned);
+        printf("Workers: %ld connected, %ld lost with tiles in hand\n", out.workers, out.lost);
+        for (int i = 0; i < dist->numConns; ++i) printf("Worker %d: %ld tiles\n", i, tiles[i]);
+    }
+
+    for (int i = 0; i < dist->depth; ++i) free(dist->slots[i].pixels);
+    free(dist->slots);
+    free(dist->units);
+    free(dist->retry);
+    free(dist->conns);
+    free(dist->argv);
+    free(dist);
+}
+
+
+// one connection of a worker process, with a renderer of its own
+typedef struct Link {
+    int fd;
+    pthread_t tid;
+    KerrArgs args;
+    Renderer *rptr;
+    Placement place;
+    long tiles;
+} Link;
+
+
+static int dial(const char *addr) {
+    // the coordinator may not be up yet
+    for (int i = 0; i < DIST_TRIES; ++i) {
+        int fd = dist_socket(addr, false);
+        if (fd >= 0) return fd;
+        usleep(DIST_RETRY_MS * 1000);
+    }
+    return -1;
+}
+
+
+static char *recv_hello(int fd, DistHello *hello) {
+    if (!recv_all(fd, hello, sizeof(DistHello)) || hello->magic != DIST_MAGIC || hello->len <= 0) return NULL;
+    char *argv = malloc(hello->len);
+    if (!recv_all(fd, argv, hello->len)) {
+        free(argv);
+        return NULL;
+    }
+    return argv;
+}
+
+
+static void *serve(void *args) {
+    Link *link = (Link *) args;
+    int width = link->rptr->width;
+    Pixel *image = malloc(width * link->rptr->height * sizeof(Pixel));
+    char *out = malloc(sizeof(DistResult) + width * link->rptr->height * sizeof(Pixel));
+    long frame = -1;
+    DistTask task;
+    while (recv_all(link->fd, &task, sizeof(task)) && task.frame >= 0) {
+        if (task.frame != frame) {
+            for (int i = 0; i < 3; ++i) link->args.pos[i] = task.pos[i];
+            render_update(link->rptr, &(link->args));
+            frame = task.frame;
+        }
+
+        // render in place as the pool would, then send the rows on together
+        RenderStats stats = {0};
+        Pixel *origin = image + task.y0 * width + task.x0;
+        if (link->rptr->refine >= 0) {
+            render_refine(link->rptr, task.x0, task.y0, task.w, task.h, origin, &stats);
+        } else {
+            for (int row = 0; row < task.h; ++row) render_span(link->rptr, (task.y0 + row) * width + task.x0, task.w, origin + row * width, &stats);
+        }
+        DistResult res = {task.frame, task.unit, stats.rays, stats.steps, {stats.fates[0], stats.fates[1], stats.fates[2]}};
+        memcpy(out, &res, sizeof(res));
+        for (int row = 0; row < task.h; ++row) memcpy(out + sizeof(res) + row * task.w * sizeof(Pixel), origin + row * width, task.w * sizeof(Pixel));
+        if (!send_all(link->fd, out, sizeof(res) + task.w * task.h * sizeof(Pixel))) break;
+        link->tiles += 1;
+    }
+    free(image);
+    free(out);
+    return NULL;
+}
+
+
+int dist_work(KerrArgs *args, const char *addr) {
+    // the first connection brings the settings to render with
+    int fd = dial(addr);
+    DistHello hello;
+    char *blob = fd >= 0 ? recv_hello(fd, &hello) : NULL;
+    if (!blob) {
+        fprintf(stderr, "Error: no coordinator at \"%s\"\n", addr);
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+    char **argv = malloc((hello.argc + 1) * sizeof(char *));
+    for (int i = 0, pos = 0; i < hello.argc; ++i) {
+        argv[i] = blob + pos;
+        pos += strlen(blob + pos) + 1;
+    }
+    argv[hello.argc] = NULL;
+    KerrArgs *remote = parse_args(hello.argc, argv);
+    if (!remote) {
+        close(fd);
+        free(argv);
+        free(blob);
+        return 1;
+    }
+
+    // one more connection per thread, each rendering on its own
+    Link *links = calloc(args->numThreads, sizeof(Link));
+    int numLinks = 0;
+    for (int i = 0; i < args->numThreads; ++i) {
+        if (i) {
+            fd = dist_socket(addr, false);
+            char *extra = fd >= 0 ? recv_hello(fd, &hello) : NULL;
+            if (!extra) {
+                if (fd >= 0) close(fd);
+                break;
+            }
+            free(extra);
+        }
+        links[numLinks].fd = fd;
+        links[numLinks].args = *remote;
+        links[numLinks].rptr = render_init(remote);
+        numLinks += 1;
+    }
+
+    // the threads are placed and pinned as the pool's would be
+    Topology topo;
+    topo_detect(&topo, "", NULL, 0);
+    const char *bind = args->bind ? args->bind : "none";
+    Placement *place = malloc(numLinks * sizeof(Placement));
+    topo_place(&topo, numLinks, bind, place);
+    for (int i = 0; i < numLinks; ++i) {
+        links[i].place = place[i];
+        if (!topo_spawn(&topo, &(links[i].place), &(links[i].tid), serve, (void *) (links + i))) {
+            fprintf(stderr, "Warning: could not pin thread %d, running it unpinned\n", i);
+        }
+    }
+    free(place);
+
+    long tiles = 0;
+    for (int i = 0; i < numLinks; ++i) {
+        pthread_join(links[i].tid, NULL);
+        tiles += links[i].tiles;
+    }
+    for (int i = 0; i < numLinks; ++i) {
+        close(links[i].fd);
+        render_free(links[i].rptr);
+    }
+    if (strcmp(args->report, "json")) printf("Worker: %ld tiles over %d connections, pinned to %s\n", tiles, numLinks, bind);
+    free(links);
+    free_args(remote);
+    free(argv);
+    free(blob);
+    return 0;
+}
@@ -0,0 +1,75 @@
+#ifndef DIST_H
+#define DIST_H
+
+
+#include <stdint.h>
+#include "args.h"
+#include "manifest.h"
+
+
+#define DIST_MAGIC 0x52415954 // "RAYT", opens the hello
+
+
+// on the wire, in host byte order since both ends run the same build: the
+// coordinator greets every connection with a DistHello and its own argv,
+// argc strings each ending in a NUL, then sends DistTasks, each answered
+// by a DistResult followed by the tile's w * h pixels, row by row
+typedef struct DistHello {
+    int32_t magic;
+    int32_t argc;
+    int32_t len;
+} DistHello;
+
+
+typedef struct DistTask {
+    int32_t frame; // -1 ends the connection
+    int32_t unit;
+    int32_t x0, y0, w, h;
+    float pos[3];
+} DistTask;
+
+
+typedef struct DistResult {
+    int32_t frame;
+    int32_t unit;
+    int64_t rays;
+    int64_t steps;
+    int64_t fates[3];
+} DistResult;
+
+
+typedef struct Dist Dist;
+
+
+// what a coordinator did over its lifetime, filled in by dist_close
+typedef struct DistStats {
+    long frames;
+    long tiles;
+    long reassigned; // tiles handed out again after their worker went away
+    long workers; // connections accepted, and how many of them dropped with tiles in hand
+    long lost;
+    long rays;
+    long steps;
+    double seconds;
+} DistStats;
+
+
+// listens on addr, "unix:PATH" or "HOST:PORT", and renders frames by handing
+// out their tiles to worker processes, writing each frame once all its tiles
+// are back; argv goes to the workers, which render with the same settings
+Dist *dist_init(KerrArgs *args, const char *addr, int argc, char **argv);
+// records written frames in the manifest, as tpool_manifest does
+void dist_manifest(Dist *dist, Manifest *manifest);
+// queues the args' current camera position as the next frame, waiting for
+// room among the frames in flight
+void dist_submit(Dist *dist, KerrArgs *args, const char *fileName);
+// finishes the queued frames and lets the workers go; the stats go to the
+// caller when it asks for them, and are printed otherwise
+void dist_close(Dist *dist, DistStats *stats);
+
+// connects args->numThreads times to the coordinator at addr and renders
+// whatever tiles it hands out until it's done; returns nonzero on failure
+int dist_work(KerrArgs *args, const char *addr);
+
+
+#endif
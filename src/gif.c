@@ -0,0 +1,282 @@
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "gif.h"
+
+#define GIF_BUCKETS 32768 // histogram of colours cut to 5 bits a channel
+#define GIF_COLOURS 256
+#define GIF_CODES 4096 // lzw codes top out at 12 bits
+#define GIF_HASH 8192 // slots in the lzw dictionary's hash table, a power of 2
+
+
+// pixels of one histogram bucket and the sums of their exact channels
+typedef struct Bucket {
+    int count;
+    int r, g, b;
+} Bucket;
+
+
+// a run of buckets that will share one palette entry
+typedef struct Box {
+    int start, end;
+    long count;
+    int axis; // channel with the widest spread, 0 red, 1 green, 2 blue
+    int extent;
+} Box;
+
+
+static int channel(int key, int axis) {
+    return (key >> (10 - 5 * axis)) & 31;
+}
+
+
+static void box_shape(Box *box, const Bucket *hist, const int *keys) {
+    int lo[3] = {31, 31, 31}, hi[3] = {0, 0, 0};
+    box->count = 0;
+    for (int i = box->start; i < box->end; ++i) {
+        box->count += hist[keys[i]].count;
+        for (int a = 0; a < 3; ++a) {
+            int v = channel(keys[i], a);
+            if (v < lo[a]) lo[a] = v;
+            if (v > hi[a]) hi[a] = v;
+        }
+    }
+    box->axis = 0;
+    for (int a = 1; a < 3; ++a) {
+        if (hi[a] - lo[a] > hi[box->axis] - lo[box->axis]) box->axis = a;
+    }
+    box->extent = hi[box->axis] - lo[box->axis];
+}
+
+
+// median cut over the frame's histogram, filling in the palette and which
+// entry each used bucket maps to; returns the number of colours
+static int quantize(const Pixel *buf, int numPx, Bucket *hist, int *keys, int *tmp, unsigned char *index, unsigned char *palette) {
+    memset(hist, 0, GIF_BUCKETS * sizeof(Bucket));
+    for (int i = 0; i < numPx; ++i) {
+        Bucket *bucket = hist + (((buf[i].r >> 3) << 10) | ((buf[i].g >> 3) << 5) | (buf[i].b >> 3));
+        bucket->count += 1;
+        bucket->r += buf[i].r;
+        bucket->g += buf[i].g;
+        bucket->b += buf[i].b;
+    }
+    int numKeys = 0;
+    for (int key = 0; key < GIF_BUCKETS; ++key) {
+        if (hist[key].count) keys[numKeys++] = key;
+    }
+
+    // keep splitting the box whose pixels are spread the furthest, at the
+    // median along its widest channel
+    Box boxes[GIF_COLOURS];
+    boxes[0] = (Box) {0, numKeys, 0, 0, 0};
+    box_shape(boxes, hist, keys);
+    int numBoxes = 1;
+    while (numBoxes < GIF_COLOURS) {
+        int pick = -1;
+        for (int i = 0; i < numBoxes; ++i) {
+            if (!boxes[i].extent) continue;
+            if (pick < 0 || boxes[i].count * boxes[i].extent > boxes[pick].count * boxes[pick].extent) pick = i;
+        }
+        if (pick < 0) break;
+        Box *box = boxes + pick;
+
+        // counting sort along the axis, there are only 32 values
+        int starts[33] = {0};
+        for (int i = box->start; i < box->end; ++i) starts[channel(keys[i], box->axis) + 1] += 1;
+        for (int v = 0; v < 32; ++v) starts[v + 1] += starts[v];
+        for (int i = box->start; i < box->end; ++i) tmp[box->start + starts[channel(keys[i], box->axis)]++] = keys[i];
+        memcpy(keys + box->start, tmp + box->start, (box->end - box->start) * sizeof(int));
+
+        long half = 0;
+        int split = box->start + 1;
+        while (split < box->end - 1 && (half += hist[keys[split - 1]].count) < box->count / 2) split += 1;
+        boxes[numBoxes] = (Box) {split, box->end, 0, 0, 0};
+        box->end = split;
+        box_shape(box, hist, keys);
+        box_shape(boxes + numBoxes, hist, keys);
+        numBoxes += 1;
+    }
+
+    // each box's colour is the mean of its pixels
+    for (int i = 0; i < numBoxes; ++i) {
+        long r = 0, g = 0, b = 0;
+        for (int k = boxes[i].start; k < boxes[i].end; ++k) {
+            r += hist[keys[k]].r;
+            g += hist[keys[k]].g;
+            b += hist[keys[k]].b;
+            index[keys[k]] = i;
+        }
+        long n = boxes[i].count ? boxes[i].count : 1;
+        palette[3 * i] = (r + n / 2) / n;
+        palette[3 * i + 1] = (g + n / 2) / n;
+        palette[3 * i + 2] = (b + n / 2) / n;
+    }
+    return numBoxes;
+}
+
+
+// lzw codes packed least significant bit first into sub-blocks of at most 255 bytes
+typedef struct Bits {
+    unsigned char *out;
+    unsigned char *block; // length byte of the sub-block being filled
+    unsigned int acc;
+    int numBits;
+} Bits;
+
+
+static void put_byte(Bits *bits, unsigned char byte) {
+    if (*bits->block == 255) {
+        bits->block = bits->out++;
+        *bits->block = 0;
+    }
+    *bits->out++ = byte;
+    *bits->block += 1;
+}
+
+
+static void put_code(Bits *bits, int code, int size) {
+    bits->acc |= (unsigned int) code << bits->numBits;
+    bits->numBits += size;
+    while (bits->numBits >= 8) {
+        put_byte(bits, bits->acc & 0xFF);
+        bits->acc >>= 8;
+        bits->numBits -= 8;
+    }
+}
+
+
+static unsigned char *lzw(unsigned char *dest, const unsigned char *idx, long numPx, int *table, int *codes) {
+    // dictionary entries are a prefix code followed by one more index, hashed
+    // into table with their code alongside; codes 256 and 257 clear it and end the data
+    *dest++ = 8;
+    Bits bits = {dest + 1, dest, 0, 0};
+    *dest = 0;
+    int size = 9, next = 258;
+    memset(table, -1, GIF_HASH * sizeof(int));
+    put_code(&bits, 256, size);
+
+    int cur = idx[0];
+    for (long i = 1; i < numPx; ++i) {
+        int key = (cur << 8) | idx[i];
+        unsigned int slot = ((unsigned int) key * 2654435761U) >> 19;
+        while (table[slot] >= 0 && table[slot] != key) slot = (slot + 1) & (GIF_HASH - 1);
+        if (table[slot] >= 0) {
+            cur = codes[slot];
+            continue;
+        }
+
+        put_code(&bits, cur, size);
+        if (next < GIF_CODES) {
+            // the decoder widens its codes once the next entry needs the extra bit
+            if (next == 1 << size) size += 1;
+            table[slot] = key;
+            codes[slot] = next++;
+        } else {
+            put_code(&bits, 256, size);
+            memset(table, -1, GIF_HASH * sizeof(int));
+            size = 9;
+            next = 258;
+        }
+        cur = idx[i];
+    }
+    put_code(&bits, cur, size);
+    if (next < GIF_CODES && next == 1 << size) size += 1;
+    put_code(&bits, 257, size);
+    if (bits.numBits) put_byte(&bits, bits.acc & 0xFF);
+
+    // an empty sub-block ends the data
+    if (*bits.block) *bits.out++ = 0;
+    return bits.out;
+}
+
+
+static void put16(unsigned char *dest, int val) {
+    dest[0] = val & 0xFF;
+    dest[1] = (val >> 8) & 0xFF;
+}
+
+
+long gif_bound(int width, int height, int rows) {
+    // header and palette, then at most 12 bits a pixel plus clear codes and sub-block lengths
+    (void) height;
+    return 1024 + 2L * width * rows;
+}
+
+
+long gif_encode(char *dest, const Pixel *buf, int width, int height, int y0, int y1, const ImgOpts *opts, long *prims) {
+    (void) y0;
+    (void) y1;
+    (void) prims;
+    long numPx = (long) width * height;
+    Bucket *hist = malloc(GIF_BUCKETS * sizeof(Bucket));
+    int *keys = malloc((2 * GIF_BUCKETS + 2 * GIF_HASH) * sizeof(int));
+    unsigned char *index = malloc(GIF_BUCKETS + numPx);
+    unsigned char *idx = index + GIF_BUCKETS;
+    unsigned char palette[3 * GIF_COLOURS] = {0};
+
+    int numColours = quantize(buf, numPx, hist, keys, keys + GIF_BUCKETS, index, palette);
+    for (long i = 0; i < numPx; ++i) idx[i] = index[((buf[i].r >> 3) << 10) | ((buf[i].g >> 3) << 5) | (buf[i].b >> 3)];
+    int tableBits = 1;
+    while (1 << tableBits < numColours) tableBits += 1;
+
+    // graphic control extension: keep the frame up for delay hundredths
+    unsigned char *out = (unsigned char *) dest;
+    unsigned char gce[8] = {0x21, 0xF9, 4, 1 << 2, 0, 0, 0, 0};
+    put16(gce + 4, opts->delay);
+    memcpy(out, gce, 8);
+    out += 8;
+
+    // image descriptor with a local colour table
+    unsigned char desc[10] = {0x2C, 0, 0, 0, 0, 0, 0, 0, 0, 0x80 | (tableBits - 1)};
+    put16(desc + 5, width);
+    put16(desc + 7, height);
+    memcpy(out, desc, 10);
+    out += 10;
+    memcpy(out, palette, 3 << tableBits);
+    out += 3 << tableBits;
+
+    out = lzw(out, idx, numPx, keys + 2 * GIF_BUCKETS, keys + 2 * GIF_BUCKETS + GIF_HASH);
+    free(hist);
+    free(keys);
+    free(index);
+    return out - (unsigned char *) dest;
+}
+
+
+long gif_flush(const char *fileName, const struct iovec *chunks, int numChunks, int width, int height, ImgOpts *opts) {
+    // the trailer is written after every frame, and the next one goes over
+    // it, so the file is a whole animation however far the run got
+    int first = !opts->frames;
+    int fd = open(fileName, first ? O_WRONLY | O_CREAT | O_TRUNC : O_WRONLY, 0666);
+    if (fd < 0) return 0;
+    if (!first && lseek(fd, -1, SEEK_END) < 0) {
+        close(fd);
+        return 0;
+    }
+
+    // screen descriptor without a global colour table, then how often to repeat
+    unsigned char head[13 + 19] = {'G', 'I', 'F', '8', '9', 'a'};
+    put16(head + 6, width);
+    put16(head + 8, height);
+    unsigned char loop[19] = {0x21, 0xFF, 11, 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0', 3, 1, 0, 0, 0};
+    put16(loop + 16, opts->loop);
+    memcpy(head + 13, loop, 19);
+    unsigned char trailer = 0x3B;
+
+    struct iovec headVec = {head, first ? (opts->loop >= 0 ? 13 + 19 : 13) : 0};
+    long written = img_flush(fd, headVec, chunks, numChunks, (struct iovec) {&trailer, 1});
+    if (close(fd) || written < 0) return 0;
+    opts->frames += 1;
+    return written;
+}
+
+
+long gif_save(const char *fileName, const Pixel *buf, int width, int height, ImgOpts *opts) {
+    char *data = malloc(gif_bound(width, height, height));
+    if (!data) return 0;
+    struct iovec chunk = {data, gif_encode(data, buf, width, height, 0, height, opts, NULL)};
+    long written = gif_flush(fileName, &chunk, 1, width, height, opts);
+    free(data);
+    return written;
+}
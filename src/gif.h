@@ -0,0 +1,19 @@
+#ifndef GIF_H
+#define GIF_H
+
+
+#include "tga.h"
+
+
+// quantizes a whole frame to its own palette and lzw compresses it into a
+// complete gif image block, which needs at most gif_bound(width, height, height)
+// bytes; the band arguments are there to fit ImgEncoder and must cover the frame
+long gif_encode(char *dest, const Pixel *buf, int width, int height, int y0, int y1, const ImgOpts *opts, long *prims);
+long gif_bound(int width, int height, int rows);
+// appends encoded frames to the animation, starting it over on the first frame
+long gif_flush(const char *fileName, const struct iovec *chunks, int numChunks, int width, int height, ImgOpts *opts);
+
+long gif_save(const char *fileName, const Pixel *buf, int width, int height, ImgOpts *opts);
+
+
+#endif
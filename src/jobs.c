@@ -0,0 +1,107 @@
+#include <errno.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/wait.h>
+#include "jobs.h"
+
+#define JOBS_POLL_MS 2 // how often a full set of jobs is checked for one that ended
+
+extern char **environ;
+
+
+// one slot per job allowed to run at once
+typedef struct Job {
+    pid_t pid; // 0 while the slot is free
+    char label[256];
+} Job;
+
+
+struct Jobs {
+    Job *slots;
+    int max;
+    int running;
+    long started;
+    long failed;
+    double blocked; // waiting for a slot to free up
+};
+
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+Jobs *jobs_init(int max) {
+    Jobs *jobs = malloc(sizeof(Jobs));
+    jobs->slots = calloc(max, sizeof(Job));
+    jobs->max = max;
+    jobs->running = 0;
+    jobs->started = 0;
+    jobs->failed = 0;
+    jobs->blocked = 0.0;
+    return jobs;
+}
+
+
+// waits for one of the jobs to end and frees its slot; only the jobs' own
+// pids are waited on, so children the rest of the process forks keep theirs
+static void reap(Jobs *jobs) {
+    while (1) {
+        for (int i = 0; i < jobs->max; ++i) {
+            Job *job = jobs->slots + i;
+            if (!job->pid) continue;
+            int status;
+            pid_t pid = waitpid(job->pid, &status, WNOHANG);
+            if (!pid || (pid < 0 && errno == EINTR)) continue;
+
+            // gone without a status means someone else reaped it
+            if (pid > 0 && (!WIFEXITED(status) || WEXITSTATUS(status))) {
+                fprintf(stderr, "Error: job for \"%s\" failed\n", job->label);
+                jobs->failed += 1;
+            }
+            job->pid = 0;
+            jobs->running -= 1;
+            return;
+        }
+        nanosleep(&(struct timespec) {0, JOBS_POLL_MS * 1000000L}, NULL);
+    }
+}
+
+
+int jobs_run(Jobs *jobs, const char *cmd, const char *label) {
+    if (jobs->running == jobs->max) {
+        double t0 = now();
+        while (jobs->running == jobs->max) reap(jobs);
+        jobs->blocked += now() - t0;
+    }
+    Job *job = jobs->slots;
+    while (job->pid) job += 1;
+
+    char *argv[] = {"sh", "-c", (char *) cmd, NULL};
+    if (posix_spawn(&(job->pid), "/bin/sh", NULL, NULL, argv, environ)) {
+        fprintf(stderr, "Error: failed to start job for \"%s\"\n", label);
+        job->pid = 0;
+        jobs->failed += 1;
+        return 0;
+    }
+    snprintf(job->label, sizeof(job->label), "%s", label);
+    jobs->running += 1;
+    jobs->started += 1;
+    return 1;
+}
+
+
+long jobs_close(Jobs *jobs, long *started, double *blocked) {
+    while (jobs->running) reap(jobs);
+    long failed = jobs->failed;
+    if (started) *started = jobs->started;
+    if (blocked) *blocked = jobs->blocked;
+    free(jobs->slots);
+    free(jobs);
+    return failed;
+}
@@ -0,0 +1,17 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+
+typedef struct Jobs Jobs;
+
+
+// runs shell commands in the background, at most max at a time
+Jobs *jobs_init(int max);
+// starts cmd once a slot is free, waiting for one if need be; label names
+// the job in error messages
+int jobs_run(Jobs *jobs, const char *cmd, const char *label);
+// waits for every job still running, then returns how many failed in all
+long jobs_close(Jobs *jobs, long *started, double *blocked);
+
+
+#endif
@@ -0,0 +1,279 @@
+#include <math.h>
+#include "render.h"
+#include "kerr.h"
+
+
+// a photon's constants of motion per unit energy: its angular momentum about
+// the spin axis and its carter constant. With them the geodesic equations
+// reduce to r'' = R'(r) / 2 and mu'' = M'(mu) / 2 in mino time, mu = cos(theta),
+// each depending on its own coordinate only and polynomial in it, with phi and
+// the affine parameter following from r and mu; five equations instead of
+// eight, no trig, and no square roots to flip the sign of at turning points
+typedef struct Geodesic {
+    double a; // spin, in units of r_s like everything else
+    double L;
+    double Q;
+    double K; // Q + (L - a)^2, what R(r) multiplies delta by
+} Geodesic;
+
+
+// the state is r, mu, phi, their mino time rates dr and dmu, and the affine
+// parameter, which is what it's stepped against: mino time runs into a pole
+// as the photon heads off to infinity, the affine parameter just keeps going
+static void kerr_deriv(Geodesic *g, const double *s, double *dest) {
+    double r = s[0], mu = s[1];
+    double a2 = g->a * g->a;
+    double P = r * r + a2 - g->a * g->L;
+    double delta = r * r - r + a2;
+    double isigma = 1.0 / (r * r + a2 * mu * mu);
+    dest[0] = s[3] * isigma;
+    dest[1] = s[4] * isigma;
+    dest[2] = (g->a * P / delta - g->a + (g->L ? g->L / (1.0 - mu * mu) : 0.0)) * isigma;
+    dest[3] = (2.0 * r * P - (r - .5) * g->K) * isigma;
+    dest[4] = (-(g->Q + g->L * g->L - a2) * mu - 2.0 * a2 * mu * mu * mu) * isigma;
+    dest[5] = 1.0;
+}
+
+
+static void kerr_step(Geodesic *g, double *s, double *ds, double *h, double tol) {
+    // Dormand-Prince 5(4) as in step_rk45, in doubles since the mino time
+    // rates grow with r^2. Its last stage is the derivative at the new state,
+    // kept in ds for the next step
+    static const double c[7][6] = {
+        {0},
+        {1.0 / 5},
+        {3.0 / 40, 9.0 / 40},
+        {44.0 / 45, -56.0 / 15, 32.0 / 9},
+        {19372.0 / 6561, -25360.0 / 2187, 64448.0 / 6561, -212.0 / 729},
+        {9017.0 / 3168, -355.0 / 33, 46732.0 / 5247, 49.0 / 176, -5103.0 / 18656},
+        {35.0 / 384, 0, 500.0 / 1113, 125.0 / 192, -2187.0 / 6784, 11.0 / 84}
+    };
+    static const double e[7] = {
+        71.0 / 57600, 0, -71.0 / 16695, 71.0 / 1920, -17253.0 / 339200, 22.0 / 525, -1.0 / 40
+    };
+
+    while (1) {
+        double k[7][6], tmp[6];
+        for (int i = 0; i < 6; ++i) k[0][i] = ds[i];
+        for (int j = 1; j < 7; ++j) {
+            for (int i = 0; i < 6; ++i) {
+                tmp[i] = s[i];
+                for (int m = 0; m < j; ++m) tmp[i] += *h * c[j][m] * k[m][i];
+            }
+            kerr_deriv(g, tmp, k[j]);
+        }
+
+        double err = 0.0;
+        for (int i = 0; i < 5; ++i) {
+            double ei = 0.0;
+            for (int j = 0; j < 7; ++j) ei += e[j] * k[j][i];
+            ei = fabs(*h * ei) / (tol * (1.0 + fabs(s[i])));
+            if (ei > err) err = ei;
+        }
+
+        double scale = err > 0.0 ? .9 * pow(err, -.2) : 5.0;
+        if (scale < .2) scale = .2;
+        else if (scale > 5.0) scale = 5.0;
+        double taken = *h;
+        *h *= scale;
+        if (!(err > 1.0) || taken < 1e-4) { // a NaN gives up, the caller sees it
+            for (int i = 0; i < 6; ++i) {
+                s[i] = tmp[i];
+                ds[i] = k[6][i];
+            }
+            return;
+        }
+    }
+}
+
+
+// pulls dr and dmu back onto R(r) = dr^2 and M(mu) = dmu^2, which the
+// integration drifts off; the constants then fix the turning points, and past a
+// pole the drift would otherwise move mu's by more than the 1 - mu^2 deciding
+// how far phi swings round
+static void kerr_project(Geodesic *g, double *s, double *ds) {
+    double r = s[0], mu = s[1], a2 = g->a * g->a;
+    double P = r * r + a2 - g->a * g->L;
+    double R = P * P - (r * r - r + a2) * g->K;
+    double M = g->Q - (g->Q + g->L * g->L - a2) * mu * mu - a2 * mu * mu * mu * mu;
+    double isigma = 1.0 / (r * r + a2 * mu * mu);
+    s[3] = copysign(sqrt(fmax(R, 0.0)), s[3]);
+    s[4] = copysign(sqrt(fmax(M, 0.0)), s[4]);
+    ds[0] = s[3] * isigma;
+    ds[1] = s[4] * isigma;
+}
+
+
+// position and coordinate basis vectors d/dr, d/dtheta, d/dphi in the scene's
+// cartesian space, taken as oblate spheroidal coordinates around the y axis
+static void kerr_basis(double a, const double *s, Vec3 pos, double basis[3][3]) {
+    double r = s[0], cth = s[1], sth = sqrt(fmax(1.0 - s[1] * s[1], 0.0)), cph = cos(s[2]), sph = sin(s[2]);
+    double A = sqrt(r * r + a * a);
+    pos[0] = A * sth * cph;
+    pos[1] = r * cth;
+    pos[2] = A * sth * sph;
+    double dr[3] = {r / A * sth * cph, cth, r / A * sth * sph};
+    double dth[3] = {A * cth * cph, -r * sth, A * cth * sph};
+    double dph[3] = {-A * sth * sph, 0.0, A * sth * cph};
+    for (int i = 0; i < 3; ++i) {
+        basis[0][i] = dr[i];
+        basis[1][i] = dth[i];
+        basis[2][i] = dph[i];
+    }
+}
+
+
+// sets g to the photon running rate times as fast as the flat rates of r, mu
+// and phi, returning how far it is from null, R(r) - dr^2
+static double launch_error(Geodesic *g, const double *s, const double *flat, double rate) {
+    double r = s[0], mu = s[1], a = g->a;
+    double sth2 = 1.0 - mu * mu;
+    double delta = r * r - r + a * a;
+    g->L = (rate * flat[2] + a - a * (r * r + a * a) / delta) / (1.0 / sth2 - a * a / delta);
+    g->Q = (rate * rate * flat[1] * flat[1] + mu * mu * (g->L * g->L - a * a * sth2)) / sth2;
+    g->K = g->Q + (g->L - a) * (g->L - a);
+    double P = r * r + a * a - a * g->L;
+    return P * P - delta * g->K - rate * rate * flat[0] * flat[0];
+}
+
+
+// the camera's ray is a direction in coordinate space, as in the schwarzschild
+// scene where its radial and sideways parts start the planar orbit off; finds
+// the photon with E = 1 heading that way, setting its dr and dmu, and returns how
+// many times faster than the ray it moves through the coordinates, or 0 if none does
+static double launch(Geodesic *g, double *s, Ray *cur) {
+    Vec3 pos;
+    double basis[3][3], flat[3];
+    kerr_basis(g->a, s, pos, basis);
+    for (int j = 0; j < 3; ++j) {
+        double len2 = 0.0;
+        flat[j] = 0.0;
+        for (int i = 0; i < 3; ++i) {
+            flat[j] += basis[j][i] * cur->dir[i];
+            len2 += basis[j][i] * basis[j][i];
+        }
+        flat[j] /= len2;
+    }
+    flat[1] *= -sqrt(1.0 - s[1] * s[1]); // dtheta to dmu
+
+    // everything in launch_error is quadratic in the rate
+    double f0 = launch_error(g, s, flat, 0.0);
+    double f1 = launch_error(g, s, flat, 1.0);
+    double fm = launch_error(g, s, flat, -1.0);
+    double qa = (f1 + fm) / 2.0 - f0, qb = (f1 - fm) / 2.0;
+    double rate;
+    if (qa == 0.0) {
+        rate = qb ? -f0 / qb : 0.0;
+    } else {
+        double disc = qb * qb - 4.0 * qa * f0;
+        if (disc < 0.0) return 0.0;
+        rate = fmax((-qb + sqrt(disc)) / (2.0 * qa), (-qb - sqrt(disc)) / (2.0 * qa));
+    }
+    if (!(rate > 0.0)) return 0.0;
+    launch_error(g, s, flat, rate);
+    s[3] = rate * flat[0];
+    s[4] = rate * flat[1];
+    return rate;
+}
+
+
+int kerr_finalpos(Renderer *rptr, Ray *cur, Vec3 dest) {
+    Geodesic g;
+    g.a = .5 * rptr->spin;
+    double a2 = g.a * g.a;
+    double rh = KERR_HORIZON * (.5 + sqrt(.25 - a2));
+
+    // boyer-lindquist coordinates of the camera, nudged off the axis where phi is undefined
+    double x = cur->pos[0], y = cur->pos[1], z = cur->pos[2];
+    double w = x * x + y * y + z * z - a2;
+    double s[6] = {sqrt(.5 * (w + sqrt(w * w + 4.0 * a2 * y * y))), 0.0, atan2(z, x), 0.0, 0.0, 0.0};
+    double mu = s[0] > 0.0 ? y / s[0] : 1.0;
+    s[1] = fmax(-1.0 + 1e-9, fmin(1.0 - 1e-9, mu));
+    double rate = s[0] >= rh ? launch(&g, s, cur) : 0.0;
+    if (!rate) {
+        for (int i = 0; i < 3; ++i) dest[i] = 0.0F;
+        return 0;
+    }
+
+    // affine lengths are scaled to start off at the ray's pace, so TMAX cuts
+    // the photon off where it would the schwarzschild scene's
+    double ds[6];
+    kerr_deriv(&g, s, ds);
+    double pace = rate / (s[0] * s[0] + a2 * s[1] * s[1]);
+    double h = rptr->stepScale * s[0] / pace;
+    int steps = 0;
+    while (1) {
+        // outbound photons past the escape radius can't come back, so they
+        // aren't held to TMAX and go on until the rest of their way out is
+        // schwarzschild's, and far_field can finish it
+        int escaping = rptr->escape && s[0] > rptr->escape && s[3] > 0.0;
+        double left = TMAX - pace * s[5];
+        if (escaping ? s[0] > KERR_FAR : left <= .001) break;
+
+        // the same limits as step_orbit's rk45, but there's no disk to stride past out there
+        if (!escaping && h * pace > .5 * s[0]) h = .5 * s[0] / pace;
+        if (!escaping && h * pace > left) h = left / pace;
+
+        double old[3] = {s[0], s[1], s[2]};
+        kerr_step(&g, s, ds, &h, rptr->tol);
+        kerr_project(&g, s, ds);
+        steps += 1;
+
+        // Photon entered event horizon, return black
+        if (!(s[0] >= rh)) {
+            for (int i = 0; i < 3; ++i) dest[i] = 0.0F;
+            return steps;
+        }
+
+        // Photon crossed the equator, where the disk lies
+        if ((old[1] < 0.0) != (s[1] < 0.0)) {
+            double f = old[1] / (old[1] - s[1]);
+            double rc = old[0] + f * (s[0] - old[0]);
+            double pc = old[2] + f * (s[2] - old[2]);
+            if (rc * rc > 9.0 && rc * rc < 36.0) {
+                // cross_disk hands back the point opposite the hit, which turns
+                // the disk's texture half a turn; keep to it so the scenes agree
+                dest[0] = -rc * cos(pc);
+                dest[1] = 0.0F;
+                dest[2] = -rc * sin(pc);
+                return steps;
+            }
+        }
+    }
+
+    // the photon's heading in the scene
+    Vec3 pos, vel;
+    double basis[3][3], len = 0.0;
+    kerr_basis(g.a, s, pos, basis);
+    double dth = -ds[1] / sqrt(fmax(1.0 - s[1] * s[1], 1e-18));
+    for (int i = 0; i < 3; ++i) {
+        vel[i] = basis[0][i] * ds[0] + basis[1][i] * dth + basis[2][i] * ds[2];
+        len += vel[i] * vel[i];
+    }
+    for (int i = 0; i < 3; ++i) vel[i] /= sqrt(len);
+
+    // finish its orbit in the plane of its position and heading like
+    // get_finalpos, or carry on in a straight line along it
+    Vec2 far;
+    Vec3 ehat0, ehat1;
+    double r = 0.0, along = 0.0, side = 0.0;
+    for (int i = 0; i < 3; ++i) r += pos[i] * pos[i];
+    r = sqrt(r);
+    for (int i = 0; i < 3; ++i) {
+        ehat0[i] = pos[i] / r;
+        along += vel[i] * ehat0[i];
+    }
+    for (int i = 0; i < 3; ++i) {
+        ehat1[i] = vel[i] - along * ehat0[i];
+        side += ehat1[i] * ehat1[i];
+    }
+    side = sqrt(side);
+    for (int i = 0; i < 3; ++i) ehat1[i] /= side;
+    Vec4 orbit = {r, 0.0F, along, side};
+    if (rptr->escape && s[0] > KERR_FAR && side > 0.0 && far_field(orbit, TMAX - pace * s[5], rptr->escape, far)) {
+        for (int i = 0; i < 3; ++i) dest[i] = far[0] * ehat0[i] + far[1] * ehat1[i];
+        return steps;
+    }
+    for (int i = 0; i < 3; ++i) dest[i] = pos[i] + 1000.0F * vel[i];
+    return steps;
+}
@@ -0,0 +1,16 @@
+#ifndef KERR_H
+#define KERR_H
+
+#include "render.h"
+
+#define KERR_FAR 20.0 // radius past which the spin barely bends an outbound photon any more
+#define KERR_HORIZON 1.01 // photons within this multiple of the outer horizon radius fall in
+
+
+// traces a photon of the spinning hole in Boyer-Lindquist coordinates, spin
+// axis along y and r_s = 1 like the schwarzschild scene, writing where it ended
+// up the way get_finalpos does so it shades the same; returns the steps taken
+int kerr_finalpos(Renderer *rptr, Ray *cur, Vec3 dest);
+
+
+#endif
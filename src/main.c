@@ -6,17 +6,46 @@
 #include "tpool.h"
 #include <sys/stat.h>
 #include "tga.h"
+#include "bench.h"
+#include "dist.h"
+#include "manifest.h"
+#include "preview.h"
 
 
 int main(int argc, char **argv) {
     struct KerrArgs *args = parse_args(argc, argv);
     if (!args) return 1;
+    if (!strcmp(args->scene, "bench")) {
+        int ret = bench_run(args);
+        free_args(args);
+        return ret;
+    }
+    if (args->workFor) {
+        int ret = dist_work(args, args->workFor);
+        free_args(args);
+        return ret;
+    }
 
     struct stat st;
     if (stat("data", &st) == -1) {
         mkdir("data", 0700);
     }
 
+    // a quick look at the start position instead of the animation
+    if (args->passes || args->passTime > 0) {
+        int ret = preview_run(args);
+        free_args(args);
+        return ret;
+    }
+
+    // frames are noted as they're written, so a killed run can be picked up
+    Manifest *manifest = manifest_open(args, MANIFEST_FILE, args->resume);
+    if (!manifest) {
+        free_args(args);
+        return 1;
+    }
+    if (args->resume && strcmp(args->report, "json")) printf("Resuming: %ld of %d frames already written\n", manifest_count(manifest), args->num_steps);
+
     const int NUM_STEPS = args->num_steps;
     float steps[3] = {
         (args->pos1[0] - args->pos0[0]) / (NUM_STEPS - 1),
@@ -24,18 +53,42 @@ int main(int argc, char **argv) {
         (args->pos1[2] - args->pos0[2]) / (NUM_STEPS - 1)
     };
 
-    args->fileName = (char *) malloc(20);
+    // one pool for the whole animation, retargeted every frame, or a
+    // coordinator handing the frames out to worker processes
+    for (int j = 0; j < 3; ++j) args->pos[j] = args->pos0[j];
+    TPool *pool = NULL;
+    Dist *dist = NULL;
+    if (args->coordinate) {
+        dist = dist_init(args, args->coordinate, argc, argv);
+        if (!dist) {
+            manifest_close(manifest);
+            free_args(args);
+            return 1;
+        }
+        dist_manifest(dist, manifest);
+    } else {
+        pool = tpool_init(args);
+        tpool_manifest(pool, manifest);
+    }
+
+    args->fileName = (char *) malloc(32);
     for (int i = 0; i < NUM_STEPS; ++i) {
-        sprintf(args->fileName, "data/%d.jgr", i);
+        if (manifest_done(manifest, i)) continue;
+        // an animated gif takes every frame into the one file
+        if (!strcmp(args->format, "gif")) sprintf(args->fileName, "video.gif");
+        else sprintf(args->fileName, "data/%d.%s", i, args->format);
         for (int j = 0; j < 3; ++j) {
             args->pos[j] = args->pos0[j] + steps[j]*i;
         }
-        printf("Step %d: {%.2f, %.2f, %.2f}\n", i, args->pos[0], args->pos[1], args->pos[2]);
+        args->step = i;
+        if (strcmp(args->report, "json")) printf("Step %d: {%.2f, %.2f, %.2f}\n", i, args->pos[0], args->pos[1], args->pos[2]);
 
-        TPool *pool = tpool_init(args);
-        for (int i = 0; i < args->width * args->height; i += args->taskSize) tpool_push(pool, i);
-        tpool_close(pool);
+        if (dist) dist_submit(dist, args, args->fileName);
+        else tpool_submit(pool, args, args->fileName);
     }
 
+    if (dist) dist_close(dist, NULL);
+    else tpool_close(pool, NULL);
+    manifest_close(manifest);
     free_args(args);
 }
\ No newline at end of file
@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "manifest.h"
+
+#define MANIFEST_HEAD "rayt manifest 1"
+
+
+struct Manifest {
+    FILE *f;
+    bool *done; // by frame
+    int numFrames;
+    long count;
+};
+
+
+// everything that changes a frame's pixels or how they are written; threads,
+// tiles and the like only change how the work is split, except that refining
+// goes tile by tile
+static void params(KerrArgs *args, char *out, int size) {
+    snprintf(
+        out, size,
+        "%s %dx%d q%d pos %.9g,%.9g,%.9g to %.9g,%.9g,%.9g dir %.9g,%.9g,%.9g fov %.9g %s tol %.9g l%d p%d k%d g%dx%d E%.9g A%.9g %s m%d D%d L%d",
+        args->scene, args->width, args->height, args->num_steps,
+        args->pos0[0], args->pos0[1], args->pos0[2], args->pos1[0], args->pos1[1], args->pos1[2],
+        args->dir[0], args->dir[1], args->dir[2], args->fov,
+        args->integrator, args->tol, args->tableSize, args->packetWidth, args->refine,
+        args->refine >= 0 ? args->tileWidth : 0, args->refine >= 0 ? args->tileHeight : 0,
+        args->escape, args->spin, args->format, args->merge, args->delay, args->loop
+    );
+}
+
+
+// 64 bit FNV-1a
+static unsigned long long hash(const char *text) {
+    unsigned long long h = 14695981039346656037ULL;
+    for (const char *c = text; *c; ++c) h = (h ^ (unsigned char) *c) * 1099511628211ULL;
+    return h;
+}
+
+
+// reads back the frames a previous run finished, if it rendered the same thing
+static bool load(Manifest *man, const char *path, const char *head) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "Error: nothing to resume, \"%s\" doesn't exist\n", path);
+        return false;
+    }
+    char line[2048], fileName[256] = "";
+    long long size = -1;
+    bool ok = fgets(line, sizeof(line), f) && !strncmp(line, MANIFEST_HEAD, strlen(MANIFEST_HEAD));
+    ok = ok && fgets(line, sizeof(line), f) && !strncmp(line, head, strlen(head));
+    if (!ok) {
+        fprintf(stderr, "Error: \"%s\" was written with different settings, can't resume from it\n", path);
+        fclose(f);
+        return false;
+    }
+    int frame;
+    char name[256];
+    long long bytes;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "frame %d %255s %lld", &frame, name, &bytes) != 3 || frame < 0 || frame >= man->numFrames) continue;
+        if (!man->done[frame]) man->count += 1;
+        man->done[frame] = true;
+        snprintf(fileName, sizeof(fileName), "%s", name);
+        size = bytes;
+    }
+    fclose(f);
+
+    // a frame may have gone into a file the manifest never heard about,
+    // which for formats that append matters; cut it back off
+    struct stat st;
+    if (size >= 0 && !stat(fileName, &st) && st.st_size > size && truncate(fileName, size)) {
+        fprintf(stderr, "Error: failed to cut \"%s\" back to its last recorded frame\n", fileName);
+        return false;
+    }
+    return true;
+}
+
+
+Manifest *manifest_open(KerrArgs *args, const char *path, bool resume) {
+    char text[1024], head[1100];
+    params(args, text, sizeof(text));
+    snprintf(head, sizeof(head), "params %016llx %s\n", hash(text), text);
+
+    Manifest *man = malloc(sizeof(Manifest));
+    man->f = NULL;
+    man->numFrames = args->num_steps;
+    man->done = calloc(man->numFrames, sizeof(bool));
+    man->count = 0;
+    if (resume && !load(man, path, head)) {
+        manifest_close(man);
+        return NULL;
+    }
+
+    // a fresh run starts the manifest over, a resumed one adds to it
+    man->f = fopen(path, resume ? "a" : "w");
+    if (!man->f) {
+        fprintf(stderr, "Error: failed to open \"%s\"\n", path);
+        manifest_close(man);
+        return NULL;
+    }
+    if (!resume) {
+        fprintf(man->f, "%s\n%s", MANIFEST_HEAD, head);
+        fflush(man->f);
+    }
+    return man;
+}
+
+
+bool manifest_done(const Manifest *man, int frame) {
+    return frame >= 0 && frame < man->numFrames && man->done[frame];
+}
+
+
+long manifest_count(const Manifest *man) {
+    return man->count;
+}
+
+
+void manifest_record(Manifest *man, int frame, const char *fileName) {
+    // the line goes out straight away, so a killed run loses no more than
+    // the frames still in flight
+    struct stat st;
+    long long size = stat(fileName, &st) ? 0 : st.st_size;
+    fprintf(man->f, "frame %d %s %lld\n", frame, fileName, size);
+    fflush(man->f);
+    if (frame >= 0 && frame < man->numFrames && !man->done[frame]) {
+        man->done[frame] = true;
+        man->count += 1;
+    }
+}
+
+
+void manifest_close(Manifest *man) {
+    if (!man) return;
+    if (man->f) fclose(man->f);
+    free(man->done);
+    free(man);
+}
@@ -0,0 +1,26 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+
+#include <stdbool.h>
+#include "args.h"
+
+#define MANIFEST_FILE "data/manifest"
+
+
+typedef struct Manifest Manifest;
+
+
+// starts a manifest of the frames written at path, headed by a hash of the
+// args that decide what the frames look like; resuming reads back the frames
+// a run with the same settings finished instead, and appends to it
+Manifest *manifest_open(KerrArgs *args, const char *path, bool resume);
+bool manifest_done(const Manifest *man, int frame);
+// frames already done, which formats that append every frame to one file go on from
+long manifest_count(const Manifest *man);
+// notes a frame as written, once its file is complete; called from one thread only
+void manifest_record(Manifest *man, int frame, const char *fileName);
+void manifest_close(Manifest *man);
+
+
+#endif
@@ -0,0 +1,198 @@
+#include <math.h>
+#include "packet.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PACKET_X86
+#endif
+
+
+static void lane_done(Packet *p, int lane, Fate fate, float end0, float end1, int steps) {
+    p->fate[lane] = fate;
+    p->end0[lane] = end0;
+    p->end1[lane] = end1;
+    p->steps[lane] = steps;
+}
+
+
+static void lane_left(Packet *p, int lane, float e0, float e1, float v0, float v1, int steps) {
+    lane_done(p, lane, ESCAPED, e0, e1, steps);
+    p->endv0[lane] = v0;
+    p->endv1[lane] = v1;
+}
+
+
+#ifdef PACKET_X86
+__attribute__((target("avx2,fma")))
+static void trace_avx2(Packet *p, int base) {
+    // the force's 1 / r^5 is built from one reciprocal square root instead of pow
+    __m256 e0 = _mm256_loadu_ps(p->e0 + base), e1 = _mm256_loadu_ps(p->e1 + base);
+    __m256 v0 = _mm256_loadu_ps(p->v0 + base), v1 = _mm256_loadu_ps(p->v1 + base);
+    __m256 L = _mm256_loadu_ps(p->L + base);
+    __m256 slope = _mm256_loadu_ps(p->slope + base);
+    __m256 k = _mm256_mul_ps(_mm256_set1_ps(-1.5F), _mm256_mul_ps(L, L));
+    __m256 dt = _mm256_set1_ps(PACKET_DT);
+    __m256 one = _mm256_set1_ps(1.0F);
+    __m256 inner = _mm256_set1_ps(9.0F), outer = _mm256_set1_ps(36.0F);
+    __m256 escape2 = _mm256_set1_ps(p->escape2 ? p->escape2 : INFINITY);
+    int alive = (1 << 8) - 1;
+    float c0s[8], c1s[8], v0s[8], v1s[8];
+
+    for (int i = 0; i < PACKET_STEPS && alive; ++i) {
+        __m256 r2 = _mm256_fmadd_ps(e0, e0, _mm256_mul_ps(e1, e1));
+        __m256 inv = _mm256_div_ps(one, _mm256_sqrt_ps(r2));
+        __m256 inv2 = _mm256_mul_ps(inv, inv);
+        __m256 c = _mm256_mul_ps(k, _mm256_mul_ps(_mm256_mul_ps(inv2, inv2), inv));
+
+        __m256 o0 = e0, o1 = e1;
+        e0 = _mm256_fmadd_ps(v0, dt, e0);
+        e1 = _mm256_fmadd_ps(v1, dt, e1);
+        v0 = _mm256_fmadd_ps(_mm256_mul_ps(o0, c), dt, v0);
+        v1 = _mm256_fmadd_ps(_mm256_mul_ps(o1, c), dt, v1);
+
+        // lanes that fell through the horizon
+        r2 = _mm256_fmadd_ps(e0, e0, _mm256_mul_ps(e1, e1));
+        int fell = _mm256_movemask_ps(_mm256_cmp_ps(r2, one, _CMP_LT_OQ)) & alive;
+
+        // lanes that crossed the disk's line, and where
+        __m256 above = _mm256_cmp_ps(_mm256_mul_ps(e0, slope), e1, _CMP_LT_OQ);
+        __m256 wasAbove = _mm256_cmp_ps(_mm256_mul_ps(o0, slope), o1, _CMP_LT_OQ);
+        int crossed = _mm256_movemask_ps(_mm256_xor_ps(above, wasAbove)) & alive & ~fell;
+        if (crossed) {
+            __m256 m = _mm256_div_ps(_mm256_sub_ps(e1, o1), _mm256_sub_ps(e0, o0));
+            __m256 b = _mm256_sub_ps(o1, _mm256_mul_ps(m, o0));
+            __m256 c0 = _mm256_div_ps(_mm256_sub_ps(_mm256_setzero_ps(), b), _mm256_sub_ps(slope, m));
+            __m256 c1 = _mm256_mul_ps(slope, c0);
+            __m256 l2 = _mm256_fmadd_ps(c0, c0, _mm256_mul_ps(c1, c1));
+            __m256 on = _mm256_and_ps(_mm256_cmp_ps(l2, inner, _CMP_GT_OQ), _mm256_cmp_ps(l2, outer, _CMP_LT_OQ));
+            crossed &= _mm256_movemask_ps(on);
+            _mm256_storeu_ps(c0s, c0);
+            _mm256_storeu_ps(c1s, c1);
+            for (int j = 0; j < 8; ++j) if (crossed & (1 << j)) lane_done(p, base + j, DISK, c0s[j], c1s[j], i + 1);
+        }
+        for (int j = 0; j < 8; ++j) if (fell & (1 << j)) lane_done(p, base + j, HORIZON, 0.0F, 0.0F, i + 1);
+        alive &= ~(fell | crossed);
+
+        // lanes heading out past the escape radius, finished off analytically
+        __m256 outward = _mm256_cmp_ps(_mm256_fmadd_ps(e0, v0, _mm256_mul_ps(e1, v1)), _mm256_setzero_ps(), _CMP_GT_OQ);
+        int left = _mm256_movemask_ps(_mm256_and_ps(_mm256_cmp_ps(r2, escape2, _CMP_GT_OQ), outward)) & alive;
+        if (left) {
+            _mm256_storeu_ps(c0s, e0);
+            _mm256_storeu_ps(c1s, e1);
+            _mm256_storeu_ps(v0s, v0);
+            _mm256_storeu_ps(v1s, v1);
+            for (int j = 0; j < 8; ++j) if (left & (1 << j)) lane_left(p, base + j, c0s[j], c1s[j], v0s[j], v1s[j], i + 1);
+            alive &= ~left;
+        }
+    }
+
+    // whatever is left escaped and carries on in a straight line
+    __m256 far = _mm256_set1_ps(1000.0F);
+    _mm256_storeu_ps(c0s, _mm256_fmadd_ps(v0, far, e0));
+    _mm256_storeu_ps(c1s, _mm256_fmadd_ps(v1, far, e1));
+    for (int j = 0; j < 8; ++j) if (alive & (1 << j)) lane_done(p, base + j, ESCAPED, c0s[j], c1s[j], PACKET_STEPS);
+}
+
+
+__attribute__((target("avx512f")))
+static void trace_avx512(Packet *p) {
+    // same as trace_avx2, sixteen lanes at a time with native mask registers
+    __m512 e0 = _mm512_loadu_ps(p->e0), e1 = _mm512_loadu_ps(p->e1);
+    __m512 v0 = _mm512_loadu_ps(p->v0), v1 = _mm512_loadu_ps(p->v1);
+    __m512 L = _mm512_loadu_ps(p->L);
+    __m512 slope = _mm512_loadu_ps(p->slope);
+    __m512 k = _mm512_mul_ps(_mm512_set1_ps(-1.5F), _mm512_mul_ps(L, L));
+    __m512 dt = _mm512_set1_ps(PACKET_DT);
+    __m512 one = _mm512_set1_ps(1.0F);
+    __m512 inner = _mm512_set1_ps(9.0F), outer = _mm512_set1_ps(36.0F);
+    __m512 escape2 = _mm512_set1_ps(p->escape2 ? p->escape2 : INFINITY);
+    __mmask16 alive = 0xFFFF;
+    float c0s[16], c1s[16], v0s[16], v1s[16];
+
+    for (int i = 0; i < PACKET_STEPS && alive; ++i) {
+        __m512 r2 = _mm512_fmadd_ps(e0, e0, _mm512_mul_ps(e1, e1));
+        __m512 inv = _mm512_div_ps(one, _mm512_sqrt_ps(r2));
+        __m512 inv2 = _mm512_mul_ps(inv, inv);
+        __m512 c = _mm512_mul_ps(k, _mm512_mul_ps(_mm512_mul_ps(inv2, inv2), inv));
+
+        __m512 o0 = e0, o1 = e1;
+        e0 = _mm512_fmadd_ps(v0, dt, e0);
+        e1 = _mm512_fmadd_ps(v1, dt, e1);
+        v0 = _mm512_fmadd_ps(_mm512_mul_ps(o0, c), dt, v0);
+        v1 = _mm512_fmadd_ps(_mm512_mul_ps(o1, c), dt, v1);
+
+        r2 = _mm512_fmadd_ps(e0, e0, _mm512_mul_ps(e1, e1));
+        __mmask16 fell = _mm512_cmp_ps_mask(r2, one, _CMP_LT_OQ) & alive;
+
+        __mmask16 above = _mm512_cmp_ps_mask(_mm512_mul_ps(e0, slope), e1, _CMP_LT_OQ);
+        __mmask16 wasAbove = _mm512_cmp_ps_mask(_mm512_mul_ps(o0, slope), o1, _CMP_LT_OQ);
+        __mmask16 crossed = (above ^ wasAbove) & alive & ~fell;
+        if (crossed) {
+            __m512 m = _mm512_div_ps(_mm512_sub_ps(e1, o1), _mm512_sub_ps(e0, o0));
+            __m512 b = _mm512_sub_ps(o1, _mm512_mul_ps(m, o0));
+            __m512 c0 = _mm512_div_ps(_mm512_sub_ps(_mm512_setzero_ps(), b), _mm512_sub_ps(slope, m));
+            __m512 c1 = _mm512_mul_ps(slope, c0);
+            __m512 l2 = _mm512_fmadd_ps(c0, c0, _mm512_mul_ps(c1, c1));
+            crossed &= _mm512_cmp_ps_mask(l2, inner, _CMP_GT_OQ) & _mm512_cmp_ps_mask(l2, outer, _CMP_LT_OQ);
+            _mm512_storeu_ps(c0s, c0);
+            _mm512_storeu_ps(c1s, c1);
+            for (int j = 0; j < 16; ++j) if (crossed & (1 << j)) lane_done(p, j, DISK, c0s[j], c1s[j], i + 1);
+        }
+        for (int j = 0; j < 16; ++j) if (fell & (1 << j)) lane_done(p, j, HORIZON, 0.0F, 0.0F, i + 1);
+        alive &= ~(fell | crossed);
+
+        __mmask16 outward = _mm512_cmp_ps_mask(_mm512_fmadd_ps(e0, v0, _mm512_mul_ps(e1, v1)), _mm512_setzero_ps(), _CMP_GT_OQ);
+        __mmask16 left = _mm512_cmp_ps_mask(r2, escape2, _CMP_GT_OQ) & outward & alive;
+        if (left) {
+            _mm512_storeu_ps(c0s, e0);
+            _mm512_storeu_ps(c1s, e1);
+            _mm512_storeu_ps(v0s, v0);
+            _mm512_storeu_ps(v1s, v1);
+            for (int j = 0; j < 16; ++j) if (left & (1 << j)) lane_left(p, j, c0s[j], c1s[j], v0s[j], v1s[j], i + 1);
+            alive &= ~left;
+        }
+    }
+
+    __m512 far = _mm512_set1_ps(1000.0F);
+    _mm512_storeu_ps(c0s, _mm512_fmadd_ps(v0, far, e0));
+    _mm512_storeu_ps(c1s, _mm512_fmadd_ps(v1, far, e1));
+    for (int j = 0; j < 16; ++j) if (alive & (1 << j)) lane_done(p, j, ESCAPED, c0s[j], c1s[j], PACKET_STEPS);
+}
+#endif
+
+
+int packet_width(void) {
+    // widest packet this cpu can run, 0 meaning stick to the scalar path
+#ifdef PACKET_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return 16;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return 8;
+#endif
+    return 0;
+}
+
+
+void packet_trace(Packet *p, int width) {
+    // pad the packet with copies of its first orbit so every lane is valid
+    for (int i = p->n; i < PACKET_MAX; ++i) {
+        p->e0[i] = p->e0[0];
+        p->e1[i] = p->e1[0];
+        p->v0[i] = p->v0[0];
+        p->v1[i] = p->v1[0];
+        p->L[i] = p->L[0];
+        p->slope[i] = p->slope[0];
+    }
+
+#ifdef PACKET_X86
+    if (width == 16) {
+        trace_avx512(p);
+        return;
+    }
+    if (width == 8) {
+        trace_avx2(p, 0);
+        if (p->n > 8) trace_avx2(p, 8);
+        return;
+    }
+#endif
+    (void) width;
+}
@@ -0,0 +1,40 @@
+#ifndef PACKET_H
+#define PACKET_H
+
+#include "render.h"
+
+#define PACKET_MAX 16
+#define PACKET_DT .01F
+#define PACKET_STEPS 3750
+
+
+// up to PACKET_MAX planar photon orbits traced in lockstep with forward
+// Euler, stored as structure of arrays so each field fills a vector register
+typedef struct Packet {
+    int n;
+
+    // orbit-plane position and velocity, angular momentum and disk line
+    float e0[PACKET_MAX];
+    float e1[PACKET_MAX];
+    float v0[PACKET_MAX];
+    float v1[PACKET_MAX];
+    float L[PACKET_MAX];
+    float slope[PACKET_MAX];
+    float escape2; // squared radius past which outbound orbits stop, 0 for never
+
+    // where each orbit ended up: disk crossing or far-away point, or for
+    // orbits that left early (fewer than PACKET_STEPS) where and how fast
+    Fate fate[PACKET_MAX];
+    float end0[PACKET_MAX];
+    float end1[PACKET_MAX];
+    float endv0[PACKET_MAX];
+    float endv1[PACKET_MAX];
+    int steps[PACKET_MAX];
+} Packet;
+
+
+int packet_width(void);
+void packet_trace(Packet *p, int width);
+
+
+#endif
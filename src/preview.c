@@ -0,0 +1,176 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "args.h"
+#include "render.h"
+#include "tga.h"
+#include "preview.h"
+
+
+// the grid a pass adds samples to: rows y0, y0 + ystep, ... of pixels
+// x0, x0 + xstep, ..., which with every earlier pass fill every sx-th
+// column of every sy-th row
+typedef struct Pass {
+    int x0, xstep;
+    int y0, ystep;
+    int sx, sy;
+} Pass;
+
+
+typedef struct PreviewArgs {
+    Renderer *rptr;
+    Pixel *image;
+    Pass pass;
+    atomic_int nextRow;
+    int numRows;
+    pthread_mutex_t mutex;
+    RenderStats stats;
+} PreviewArgs;
+
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+// pass 0 samples every PREVIEW_STRIDE pixels each way, then the passes
+// halve the spacing across and down in turn, so each doubles the samples
+static Pass make_pass(int p) {
+    int sx = PREVIEW_STRIDE >> ((p + 1) / 2);
+    int sy = PREVIEW_STRIDE >> (p / 2);
+    if (!p) return (Pass) {0, sx, 0, sy, sx, sy};
+    if (p % 2) return (Pass) {sx, 2 * sx, 0, sy, sx, sy};
+    return (Pass) {0, sx, sy, 2 * sy, sx, sy};
+}
+
+
+static void *trace_rows(void *args) {
+    PreviewArgs *pargs = (PreviewArgs *) args;
+    Renderer *rptr = pargs->rptr;
+    Pass *pass = &(pargs->pass);
+    int *pxs = malloc(rptr->width * sizeof(int));
+    Pixel *out = malloc(rptr->width * sizeof(Pixel));
+    RenderStats stats = {0};
+
+    // rows of the pass go to whichever thread is free
+    int row;
+    while ((row = atomic_fetch_add(&(pargs->nextRow), 1)) < pargs->numRows) {
+        int y = pass->y0 + row * pass->ystep;
+        int n = 0;
+        for (int x = pass->x0; x < rptr->width; x += pass->xstep) pxs[n++] = y * rptr->width + x;
+        render_list(rptr, pxs, n, out, &stats);
+        for (int i = 0; i < n; ++i) pargs->image[pxs[i]] = out[i];
+    }
+
+    pthread_mutex_lock(&(pargs->mutex));
+    pargs->stats.rays += stats.rays;
+    pargs->stats.steps += stats.steps;
+    pthread_mutex_unlock(&(pargs->mutex));
+    free(pxs);
+    free(out);
+    return NULL;
+}
+
+
+// fills every pixel off the sx x sy grid from the grid's four samples around it
+static void fill_holes(const Pixel *image, Pixel *dest, int width, int height, int sx, int sy) {
+    for (int y = 0; y < height; ++y) {
+        int ya = y - y % sy;
+        int yb = ya + sy < height ? ya + sy : ya;
+        float fy = yb > ya ? (y - ya) / (float) sy : 0.0F;
+        for (int x = 0; x < width; ++x) {
+            int xa = x - x % sx;
+            int xb = xa + sx < width ? xa + sx : xa;
+            float fx = xb > xa ? (x - xa) / (float) sx : 0.0F;
+            const Pixel *c00 = image + ya * width + xa, *c10 = image + ya * width + xb;
+            const Pixel *c01 = image + yb * width + xa, *c11 = image + yb * width + xb;
+            float w00 = (1 - fx) * (1 - fy), w10 = fx * (1 - fy), w01 = (1 - fx) * fy, w11 = fx * fy;
+            dest[y * width + x] = (Pixel) {
+                (unsigned char) (c00->b * w00 + c10->b * w10 + c01->b * w01 + c11->b * w11 + .5F),
+                (unsigned char) (c00->g * w00 + c10->g * w10 + c01->g * w01 + c11->g * w11 + .5F),
+                (unsigned char) (c00->r * w00 + c10->r * w10 + c01->r * w01 + c11->r * w11 + .5F)
+            };
+        }
+    }
+}
+
+
+int preview_run(KerrArgs *args) {
+    bool json = !strcmp(args->report, "json");
+    ImgWriter save = img_writer(args->format);
+    char fileName[64];
+    snprintf(fileName, sizeof(fileName), "%s", !strcmp(args->format, "gif") ? "preview.gif" : "data/preview.");
+    if (strcmp(args->format, "gif")) strncat(fileName, args->format, sizeof(fileName) - strlen(fileName) - 1);
+
+    for (int j = 0; j < 3; ++j) args->pos[j] = args->pos0[j];
+    PreviewArgs pargs;
+    pargs.rptr = render_init(args);
+    int numPx = args->width * args->height;
+    pargs.image = malloc(numPx * sizeof(Pixel));
+    Pixel *preview = malloc(numPx * sizeof(Pixel));
+    pargs.stats = (RenderStats) {0};
+    pthread_mutex_init(&(pargs.mutex), NULL);
+    pthread_t *tids = malloc(args->numThreads * sizeof(pthread_t));
+
+    int passes = args->passes > PREVIEW_PASSES || !args->passes ? PREVIEW_PASSES : args->passes;
+    double started = now();
+    if (json) printf("{\n  \"file\": \"%s\",\n  \"passes\": [\n", fileName);
+    int p;
+    for (p = 0; p < passes; ++p) {
+        pargs.pass = make_pass(p);
+        pargs.numRows = (args->height - pargs.pass.y0 + pargs.pass.ystep - 1) / pargs.pass.ystep;
+        if (pargs.numRows < 0) pargs.numRows = 0;
+        atomic_init(&(pargs.nextRow), 0);
+        long raysBefore = pargs.stats.rays;
+        double t0 = now();
+        for (int i = 0; i < args->numThreads; ++i) pthread_create(tids + i, NULL, trace_rows, (void *) &pargs);
+        for (int i = 0; i < args->numThreads; ++i) pthread_join(tids[i], NULL);
+        double traced = now() - t0;
+
+        // the last pass has every pixel, the others get their holes filled
+        t0 = now();
+        const Pixel *out = pargs.image;
+        if (pargs.pass.sx > 1 || pargs.pass.sy > 1) {
+            fill_holes(pargs.image, preview, args->width, args->height, pargs.pass.sx, pargs.pass.sy);
+            out = preview;
+        }
+        ImgOpts opts = {args->merge, args->delay, args->loop, 0, 0};
+        if (!save(fileName, out, args->width, args->height, &opts)) fprintf(stderr, "Error: failed to write \"%s\"\n", fileName);
+        double written = now() - t0;
+
+        double elapsed = now() - started;
+        bool last = p == passes - 1 || (args->passTime > 0 && elapsed >= args->passTime);
+        if (json) {
+            printf(
+                "    {\"pass\": %d, \"grid\": [%d, %d], \"rays\": %ld, \"traced\": %.4f, \"written\": %.4f, \"elapsed\": %.4f}%s\n",
+                p, pargs.pass.sx, pargs.pass.sy, pargs.stats.rays - raysBefore, traced, written, elapsed, last ? "" : ","
+            );
+        } else {
+            printf(
+                "Pass %d: every %dx%d pixels, %.1f%% traced, %.3fs tracing, %.3fs writing, %.3fs in\n",
+                p, pargs.pass.sx, pargs.pass.sy, 100.0 * pargs.stats.rays / numPx, traced, written, elapsed
+            );
+        }
+        fflush(stdout);
+        if (last) break;
+    }
+
+    double seconds = now() - started;
+    if (json) {
+        printf("  ],\n  \"rays\": %ld, \"steps\": %ld, \"seconds\": %.4f\n}\n", pargs.stats.rays, pargs.stats.steps, seconds);
+    } else {
+        printf("Preview: %d of %d passes in %.3fs, %ld rays, written to %s\n", p + 1, passes, seconds, pargs.stats.rays, fileName);
+    }
+
+    pthread_mutex_destroy(&(pargs.mutex));
+    render_free(pargs.rptr);
+    free(pargs.image);
+    free(preview);
+    free(tids);
+    return 0;
+}
@@ -0,0 +1,17 @@
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+
+#include "args.h"
+
+#define PREVIEW_STRIDE 16 // pixels between the first pass's samples, each way
+#define PREVIEW_PASSES 9 // passes from that grid to every pixel, 1 + 2 log2(PREVIEW_STRIDE)
+
+
+// renders the start position in passes of twice the density of the one
+// before, writing a hole-filled data/preview after each, until args->passes
+// passes are done or args->passTime seconds are up
+int preview_run(KerrArgs *args);
+
+
+#endif
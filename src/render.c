@@ -1,16 +1,23 @@
 #include <math.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include "tga.h"
 #include "render.h"
+#include "packet.h"
+#include "kerr.h"
 
 #define PI 3.1415926535F
+#define DT .01F // step of the original Euler integration
+#define GRID 4 // pixels between coarse samples when refining
+#define BLOCK 256 // widest run of a tile refined at once, bounds the stack
+#define PACKET_CHUNK 64 // pixels set up for the packets at once
 
 
-typedef struct Ray {
-    Vec3 pos;
-    Vec3 dir;
-} Ray;
+static void build_table(Renderer *rptr);
+static Pixel render_schwarz(Renderer *rptr, Ray *cur, RenderStats *stats);
+static Pixel render_sphere(Renderer *rptr, Ray *cur, RenderStats *stats);
+static Pixel render_kerr(Renderer *rptr, Ray *cur, RenderStats *stats);
 
 
 // helper functions for handling vectors and matrices
@@ -53,7 +60,7 @@ static float dotV3(Vec3 a, Vec3 b) {
 
 
 // actual rendering functions
-static Ray *create_ray(Renderer *rptr, int px) {
+static void create_ray(Renderer *rptr, int px, Ray *out) {
     // thanks to https://www.scratchapixel.com/lessons/3d-basic-rendering/ray-tracing-generating-camera-rays/generating-camera-rays.html
     // also thanks http://www.codinglabs.net/article_world_view_projection_matrix.aspx
 
@@ -68,16 +75,13 @@ static Ray *create_ray(Renderer *rptr, int px) {
     // printf("[%d] Screen Space: %.2f, %.2f\n", px, scrnx, scrny);
 
     // determine camera space of pixel
-    float aspect = rptr->width / (float) rptr->height;
-    float tana = tan(rptr->fov / 360.0F * PI);
-    float camx = scrnx * aspect * tana;
-    float camy = scrny * tana;
+    float camx = scrnx * rptr->aspect * rptr->tana;
+    float camy = scrny * rptr->tana;
     // printf("[%d] Camera Space: %.2f, %.2f\n", px, camx, camy);
 
     Vec4 camSpace = {camx, camy, 1, 1};
 
     // get direction of ray
-    Ray *out = malloc(sizeof(Ray));
     Vec4 worldSpace4 = {0.0F, 0.0F, 0.0F, 0.0F};
     mulM4V4(rptr->view, camSpace, worldSpace4);
     Vec3 worldSpace3 = {0.0F, 0.0F, 0.0F};
@@ -92,46 +96,81 @@ static Ray *create_ray(Renderer *rptr, int px) {
     vnorm(direction);
 
     for (int i = 0; i < 3; ++i) out->dir[i] = direction[i];
-
-    return out;
 }
 
 
 Renderer *render_init(KerrArgs *args) {
     Renderer *out = malloc(sizeof(Renderer));
-    for (int i = 0; i < 3; ++i) {
-        out->pos[i] = args->pos[i];
-        out->dir[i] = args->dir[i];
-    }
     out->fov = args->fov;
     out->width = args->width;
     out->height = args->height;
-    out->scene = args->scene;
+    out->aspect = args->width / (float) args->height;
+    out->tana = tan(args->fov / 360.0F * PI);
+    if (!strcmp(args->scene, "schwarz")) out->sceneFn = render_schwarz;
+    else if (!strcmp(args->scene, "kerr")) out->sceneFn = render_kerr;
+    else out->sceneFn = render_sphere;
+    out->tol = args->tol;
+    out->stepScale = powf(args->tol, .25F);
+    if (!strcmp(args->integrator, "rk4")) out->integrator = RK4;
+    else if (!strcmp(args->integrator, "rk45")) out->integrator = RK45;
+    else if (!strcmp(args->integrator, "leapfrog")) out->integrator = LEAPFROG;
+    else out->integrator = EULER;
+    out->tableSize = !strcmp(args->scene, "schwarz") ? args->tableSize : 0;
+    out->refine = args->refine;
+    out->escape = args->escape;
+    out->spin = args->spin;
+    out->packetWidth = packet_width();
+    if (args->packetWidth >= 0 && args->packetWidth < out->packetWidth) out->packetWidth = args->packetWidth;
+    out->orbits = out->tableSize ? malloc(out->tableSize * sizeof(Orbit)) : NULL;
+    out->orbitPts = NULL;
+    out->numOrbitPts = 0;
+    out->capOrbitPts = 0;
+    render_update(out, args);
+    out->tableSteps = 0;
+    return out;
+}
+
+
+void render_update(Renderer *rptr, KerrArgs *args) {
+    // move the camera to the args' current position, reusing the renderer
+    for (int i = 0; i < 3; ++i) {
+        rptr->pos[i] = args->pos[i];
+        rptr->dir[i] = args->dir[i];
+    }
 
     // compute view matrix
     //     thanks to https://www.3dgep.com/understanding-the-view-matrix/
     Vec3 forward = {args->dir[0], args->dir[1], args->dir[2]};
     Vec3 position = {args->pos[0], args->pos[1], args->pos[2]};
-    for (int i = 0; i < 3; ++i) out->view[i][2] = forward[i];
+    for (int i = 0; i < 3; ++i) rptr->view[i][2] = forward[i];
 
     //     cross product between cam's forward (dir) and true Y => cam's right vector
     Vec3 right = {0.0F, 0.0F, 0.0F};
     Vec3 trueY = {0.0F, 1.0F, 0.0F};
     vcross(forward, trueY, right);
     vnorm(right);
-    for (int i = 0; i < 3; ++i) out->view[i][0] = right[i];
+    for (int i = 0; i < 3; ++i) rptr->view[i][0] = right[i];
 
     //     cross product between cam's right and cam's forward => cam's up vector
     Vec3 up = {0.0F, 0.0F, 0.0F};
     vcross(right, forward, up);
     vnorm(up);
-    for (int i = 0; i < 3; ++i) out->view[i][1] = up[i];
+    for (int i = 0; i < 3; ++i) rptr->view[i][1] = up[i];
 
     //     set position of camera
-    out->view[3][3] = 1.0F;
-    for (int i = 0; i < 3; ++i) out->view[i][3] = position[i];
+    for (int i = 0; i < 3; ++i) rptr->view[3][i] = 0.0F;
+    rptr->view[3][3] = 1.0F;
+    for (int i = 0; i < 3; ++i) rptr->view[i][3] = position[i];
 
-    return out;
+    if (rptr->tableSize) build_table(rptr);
+}
+
+
+void render_free(Renderer *rptr) {
+    if (!rptr) return;
+    free(rptr->orbits);
+    free(rptr->orbitPts);
+    free(rptr);
 }
 
 
@@ -167,7 +206,10 @@ static void pierce_atm(Ray *cur, Vec2 dest) {
 }
 
 
-static Pixel render_sphere(Ray *cur) {
+static Pixel render_sphere(Renderer *rptr, Ray *cur, RenderStats *stats) {
+    (void) rptr;
+    (void) stats;
+
     // check for ray collision with sphere
     Vec2 info = {0.0F, 0.0F};
     pierce_atm(cur, info);
@@ -217,68 +259,271 @@ static void get_ea(float L, Vec2 ep, Vec2 dest) { // Returns the second derivati
 }
 
 
-static void get_finalpos(Ray *cur, Vec3 dest) {
-    // Initialize constants, ehat0, ehat1 ep, ev
-    int N = 3750; // 750
-    float dt = .01F; // .05F
-    Vec2 ep = {vlen(cur->pos), 0.0F};
-    Vec3 ehat0 = {
-        cur->pos[0] / ep[0],
-        cur->pos[1] / ep[0],
-        cur->pos[2] / ep[0]
+// each integrator advances the state {ep, ev} by up to *h and returns the
+// step it actually took, leaving its choice for the next step in *h
+static float step_euler(float L, Vec4 s, float *h) {
+    // forward Euler, the original fixed step method
+    Vec2 step_ev = {0.0F, 0.0F};
+    get_ea(L, s, step_ev);
+    s[0] += s[2] * *h;
+    s[1] += s[3] * *h;
+    s[2] += step_ev[0] * *h;
+    s[3] += step_ev[1] * *h;
+    return *h;
+}
+
+
+static void deriv(float L, Vec4 s, Vec4 dest) {
+    dest[0] = s[2];
+    dest[1] = s[3];
+    get_ea(L, s, dest + 2);
+}
+
+
+static float step_rk4(float L, Vec4 s, float *h) {
+    // classic fourth order Runge-Kutta
+    Vec4 k1, k2, k3, k4, tmp;
+    deriv(L, s, k1);
+    for (int i = 0; i < 4; ++i) tmp[i] = s[i] + .5F * *h * k1[i];
+    deriv(L, tmp, k2);
+    for (int i = 0; i < 4; ++i) tmp[i] = s[i] + .5F * *h * k2[i];
+    deriv(L, tmp, k3);
+    for (int i = 0; i < 4; ++i) tmp[i] = s[i] + *h * k3[i];
+    deriv(L, tmp, k4);
+    for (int i = 0; i < 4; ++i) s[i] += *h / 6.0F * (k1[i] + 2.0F * k2[i] + 2.0F * k3[i] + k4[i]);
+    return *h;
+}
+
+
+static float step_leapfrog(float L, Vec4 s, float *h) {
+    // kick-drift-kick leapfrog, symplectic for a fixed step
+    Vec2 a = {0.0F, 0.0F};
+    get_ea(L, s, a);
+    s[2] += .5F * *h * a[0];
+    s[3] += .5F * *h * a[1];
+    s[0] += *h * s[2];
+    s[1] += *h * s[3];
+    get_ea(L, s, a);
+    s[2] += .5F * *h * a[0];
+    s[3] += .5F * *h * a[1];
+    return *h;
+}
+
+
+static float step_rk45(float L, Vec4 s, float *h, float tol) {
+    // Dormand-Prince 5(4), retrying with a smaller step until the
+    // embedded error estimate is within tolerance
+    static const float c[7][6] = {
+        {0},
+        {1.0F / 5},
+        {3.0F / 40, 9.0F / 40},
+        {44.0F / 45, -56.0F / 15, 32.0F / 9},
+        {19372.0F / 6561, -25360.0F / 2187, 64448.0F / 6561, -212.0F / 729},
+        {9017.0F / 3168, -355.0F / 33, 46732.0F / 5247, 49.0F / 176, -5103.0F / 18656},
+        {35.0F / 384, 0, 500.0F / 1113, 125.0F / 192, -2187.0F / 6784, 11.0F / 84}
     };
-    float dot = dotV3(cur->dir, ehat0);
-    Vec3 ehat1 = {
-        cur->dir[0] - dot * ehat0[0],
-        cur->dir[1] - dot * ehat0[1],
-        cur->dir[2] - dot * ehat0[2]
+    static const float e[7] = {
+        71.0F / 57600, 0, -71.0F / 16695, 71.0F / 1920, -17253.0F / 339200, 22.0F / 525, -1.0F / 40
     };
+
+    while (true) {
+        Vec4 k[7], tmp;
+        deriv(L, s, k[0]);
+        for (int j = 1; j < 7; ++j) {
+            for (int i = 0; i < 4; ++i) {
+                tmp[i] = s[i];
+                for (int m = 0; m < j; ++m) tmp[i] += *h * c[j][m] * k[m][i];
+            }
+            deriv(L, tmp, k[j]);
+        }
+
+        // tmp holds the fifth order solution, which is also the last stage's input
+        float err = 0.0F;
+        for (int i = 0; i < 4; ++i) {
+            float ei = 0.0F;
+            for (int j = 0; j < 7; ++j) ei += e[j] * k[j][i];
+            ei = fabsf(*h * ei) / (tol * (1.0F + fabsf(s[i])));
+            if (ei > err) err = ei;
+        }
+
+        float scale = err > 0.0F ? .9F * powf(err, -.2F) : 5.0F;
+        if (scale < .2F) scale = .2F;
+        else if (scale > 5.0F) scale = 5.0F;
+        float taken = *h;
+        *h *= scale;
+        if (err <= 1.0F || taken < 1e-4F) {
+            for (int i = 0; i < 4; ++i) s[i] = tmp[i];
+            return taken;
+        }
+    }
+}
+
+
+static float step_orbit(Renderer *rptr, float L, Vec4 s, float *h, float left) {
+    // higher order fixed step methods take steps proportional to the
+    // radius, small around the photon sphere and large far from the hole,
+    // and the adaptive one is kept from striding past the disk
+    float r = vlen((Vec3) {s[0], s[1], 0.0F});
+    if (rptr->integrator == RK4 || rptr->integrator == LEAPFROG) *h = rptr->stepScale * r;
+    else if (rptr->integrator == RK45 && *h > .5F * r) *h = .5F * r;
+    if (rptr->integrator != EULER && *h > left) *h = left;
+
+    switch (rptr->integrator) {
+        case RK4:      return step_rk4(L, s, h);
+        case LEAPFROG: return step_leapfrog(L, s, h);
+        case RK45:     return step_rk45(L, s, h, rptr->tol);
+        default:       return step_euler(L, s, h);
+    }
+}
+
+
+static float first_step(Renderer *rptr, float r0) {
+    return rptr->integrator == EULER ? DT : rptr->stepScale * r0;
+}
+
+
+static int cross_disk(Vec2 old_ep, Vec2 ep, float diskSlope, Vec2 dest) {
+    // where the chord old_ep -> ep meets the disk's line, if that's on the disk
+    float current_m = (ep[1] - old_ep[1]) / (ep[0] - old_ep[0]);
+    float current_b = old_ep[1] - current_m * old_ep[0];
+    float cross_e0 = -current_b / (diskSlope - current_m);
+    float cross_e1 = diskSlope * cross_e0;
+    float final_len2 = cross_e0 * cross_e0 + cross_e1 * cross_e1;
+    dest[0] = cross_e0;
+    dest[1] = cross_e1;
+    return final_len2 > 9.0F && final_len2 < 36.0F;
+}
+
+
+static void orbit_basis(Ray *cur, Vec3 ehat0, Vec3 ehat1, Vec2 ep, Vec2 ev) {
+    // the photon's orbit stays in the plane spanned by the radial direction
+    // ehat0 and the perpendicular part of the ray's direction ehat1
+    ep[0] = vlen(cur->pos);
+    ep[1] = 0.0F;
+    for (int i = 0; i < 3; ++i) ehat0[i] = cur->pos[i] / ep[0];
+    float dot = dotV3(cur->dir, ehat0);
+    for (int i = 0; i < 3; ++i) ehat1[i] = cur->dir[i] - dot * ehat0[i];
     vnorm(ehat1);
-    Vec2 ev = {dotV3(cur->dir, ehat0), dotV3(cur->dir, ehat1)};
+    ev[0] = dotV3(cur->dir, ehat0);
+    ev[1] = dotV3(cur->dir, ehat1);
+}
+
+
+// angle an orbit with periapsis 1 / ut sweeps while u = ut sin(a) runs over
+// [a0, a1]: along u'^2 = B - u^2 + u^3 that's the smooth integral below, taken
+// with 8 point gauss-legendre
+static double sweep(double ut, double a0, double a1) {
+    static const double x[4] = {0.1834346424956498, 0.5255324099163290, 0.7966664774136267, 0.9602898564975363};
+    static const double w[4] = {0.3626837833783620, 0.3137066458778873, 0.2223810344533745, 0.1012285362903763};
+    double mid = (a0 + a1) / 2.0, half = (a1 - a0) / 2.0, sum = 0.0;
+    for (int i = 0; i < 8; ++i) {
+        double sa = sin(mid + half * (i < 4 ? -x[i] : x[i - 4]));
+        sum += w[i % 4] / sqrt(1.0 - ut * (sa + 1.0 / (1.0 + sa)));
+    }
+    return sum * half;
+}
+
+
+// periapsis of an orbit, where B - u^2 + u^3 falls to 0, between lo and hi
+static double periapsis(double B, double lo, double hi) {
+    for (int i = 0; i < 40; ++i) {
+        double mid = (lo + hi) / 2.0;
+        if (mid * mid * mid - mid * mid + B > 0.0) lo = mid;
+        else hi = mid;
+    }
+    return (lo + hi) / 2.0;
+}
+
+
+// analytic continuation of an orbit from state s out to infinity. In u = 1 / r
+// against the swept angle, orbits obey u'^2 = B - u^2 + u^3, so the angle left
+// to sweep is the integral of du / sqrt(B - u^2 + u^3) out to u = 0, through
+// the periapsis first if the photon is still falling in. Only done when the
+// rest of the orbit stays outside radius, so it can't meet the disk or the
+// horizon; writes the point the integration would have extrapolated to after
+// the remaining left of TMAX and returns 1, or returns 0
+int far_field(Vec4 s, float left, float radius, Vec2 dest) {
+    double r = sqrt(s[0] * s[0] + s[1] * s[1]);
+    double L = s[0] * s[3] - s[1] * s[2];
+    double u = 1.0 / r;
+    if (u >= 1.0 / radius || L == 0.0) return 0;
+    double du = -(s[0] * s[2] + s[1] * s[3]) / r / fabs(L);
+    double B = du * du + u * u - u * u * u;
+
+    double a;
+    if (du <= 0.0 && B >= 4.0 / 27.0) {
+        // heading out with no periapsis: the weak-field expansion in u^3 is plenty
+        double w0 = B - u * u;
+        a = asin(u / sqrt(B)) - .5 * (B / sqrt(w0) + sqrt(w0) - 2.0 * sqrt(B));
+    } else if (du <= 0.0) {
+        double ut = periapsis(B, u, 2.0 / 3.0);
+        a = sweep(ut, 0.0, asin(u / ut));
+    } else {
+        double ur = 1.0 / radius;
+        if (ur * ur * ur - ur * ur + B >= 0.0) return 0; // swings in past radius
+        double ut = periapsis(B, u, ur);
+        a = sweep(ut, asin(u / ut), PI / 2.0) + sweep(ut, 0.0, PI / 2.0);
+    }
+
+    // the asymptote: heading, offset L / v from the hole, and how far along it the photon gets
+    double v2 = s[2] * s[2] + s[3] * s[3] - L * L * u * u * u;
+    if (v2 <= 0.0) return 0;
+    double v = sqrt(v2);
+    double phi = atan2(s[1], s[0]) + (L > 0.0 ? a : -a);
+    double d0 = cos(phi), d1 = sin(phi);
+    double along = s[0] * d0 + s[1] * d1 + (left + 1000.0) * v;
+    dest[0] = (float) (L / v * d1 + along * d0);
+    dest[1] = (float) (-L / v * d0 + along * d1);
+    return 1;
+}
+
+
+static int get_finalpos(Renderer *rptr, Ray *cur, Vec3 dest) {
+    // Initialize constants, ehat0, ehat1 ep, ev
+    Vec3 ehat0, ehat1;
+    Vec2 ep, ev;
+    orbit_basis(cur, ehat0, ehat1, ep, ev);
     float L = ep[0] * ev[1];
     float diskSlope = -ehat0[1] / ehat1[1];
 
-    for (int i = 0; i < N; ++i) {
-        // Euler's method
-        Vec2 step_ep = {ev[0] * dt, ev[1] * dt};
-        Vec2 step_ev = {0.0F, 0.0F};
-        get_ea(L, ep, step_ev);
-        step_ev[0] *= dt; step_ev[1] *= dt;
-
-        // Update variables
-        Vec2 old_ep = {ep[0], ep[1]};
-        ep[0] += step_ep[0];
-        ep[1] += step_ep[1];
-        ev[0] += step_ev[0];
-        ev[1] += step_ev[1];
+    Vec4 s = {ep[0], ep[1], ev[0], ev[1]};
+    float t = 0.0F;
+    float h = first_step(rptr, ep[0]);
+    int steps = 0;
+    Vec2 finalep;
+    if (rptr->escape && far_field(s, TMAX, rptr->escape, finalep)) { // never comes near the hole
+        for (int i = 0; i < 3; ++i) dest[i] = finalep[0] * ehat0[i] + finalep[1] * ehat1[i];
+        return 0;
+    }
+    while (TMAX - t > .001F) {
+        Vec2 old_ep = {s[0], s[1]};
+        t += step_orbit(rptr, L, s, &h, TMAX - t);
+        steps += 1;
+        ep[0] = s[0]; ep[1] = s[1];
+        ev[0] = s[2]; ev[1] = s[3];
 
         // Photon entered event horizon, return black
         if (sqrt(ep[0] * ep[0] + ep[1] * ep[1]) < 1.0F) {
             for (int i = 0; i < 3; ++i) dest[i] = 0.0F;
-            return;
+            return steps;
         }
 
         // Photon hit accretion disk
-        if (((ep[0] * diskSlope) < ep[1]) != ((old_ep[0] * diskSlope) < old_ep[1])) {
-            float current_m = (ep[1] - old_ep[1]) / (ep[0] - old_ep[0]);
-            float current_b = old_ep[1] - current_m * old_ep[0];
-            float cross_e0 = -current_b / (diskSlope - current_m);
-            float cross_e1 = diskSlope * cross_e0;
-            Vec3 finalPos = {
-                cross_e0 * ehat0[0] + cross_e1 * ehat1[0],
-                cross_e0 * ehat0[1] + cross_e1 * ehat1[1],
-                cross_e0 * ehat0[2] + cross_e1 * ehat1[2],
-            };
-            float final_len2 = cross_e0 * cross_e0 + cross_e1 * cross_e1;
-
-            if (final_len2 > 9.0F && final_len2 < 36.0F) {
-                for (int i = 0; i < 3; ++i) dest[i] = finalPos[i];
-                return;
-            }
+        Vec2 cross = {0.0F, 0.0F};
+        if (((ep[0] * diskSlope) < ep[1]) != ((old_ep[0] * diskSlope) < old_ep[1]) && cross_disk(old_ep, ep, diskSlope, cross)) {
+            for (int i = 0; i < 3; ++i) dest[i] = cross[0] * ehat0[i] + cross[1] * ehat1[i];
+            return steps;
+        }
+
+        // Photon heading out past the escape radius can't come back
+        if (rptr->escape && ep[0] * ep[0] + ep[1] * ep[1] > rptr->escape * rptr->escape && ep[0] * ev[0] + ep[1] * ev[1] > 0.0F && far_field(s, TMAX - t, rptr->escape, finalep)) {
+            for (int i = 0; i < 3; ++i) dest[i] = finalep[0] * ehat0[i] + finalep[1] * ehat1[i];
+            return steps;
         }
     }
 
-    Vec2 finalep = {ep[0] + 1000.0F * ev[0], ep[1] + 1000.0F * ev[1]};
+    finalep[0] = ep[0] + 1000.0F * ev[0];
+    finalep[1] = ep[1] + 1000.0F * ev[1];
     Vec3 finalPos = {
         finalep[0] * ehat0[0] + finalep[1] * ehat1[0],
         finalep[0] * ehat0[1] + finalep[1] * ehat1[1],
@@ -286,18 +531,144 @@ static void get_finalpos(Ray *cur, Vec3 dest) {
     };
 
     for (int i = 0; i < 3; ++i) dest[i] = finalPos[i]; // Assume photon is far enough away from black hole to travel in straight line
+    return steps;
 }
 
 
-static Pixel render_schwarz(Ray *cur) {
-    // determine final position of photon
-    Vec3 finalPos = {0.0F, 0.0F, 0.0F};
-    get_finalpos(cur, finalPos);
+// trajectory table: every ray of a frame starts at the same radius, so its
+// planar orbit only depends on the angle it leaves at relative to the radial
+// direction; the disk's orientation within that plane is what differs per pixel
+static void add_point(Renderer *rptr, Vec4 s, float phi) {
+    if (rptr->numOrbitPts == rptr->capOrbitPts) {
+        rptr->capOrbitPts = rptr->capOrbitPts ? 2 * rptr->capOrbitPts : 1 << 16;
+        rptr->orbitPts = realloc(rptr->orbitPts, rptr->capOrbitPts * sizeof(Vec3));
+    }
+    float *pt = rptr->orbitPts[rptr->numOrbitPts++];
+    pt[0] = s[0];
+    pt[1] = s[1];
+    pt[2] = phi;
+}
+
+
+static void build_table(Renderer *rptr) {
+    // trace each angle once, keeping points whenever the orbit has swung
+    // far enough for a chord between them to stand in for the curve
+    float r0 = vlen(rptr->pos);
+    float maxDphi = PI / 256.0F;
+    rptr->numOrbitPts = 0;
+
+    for (int i = 0; i < rptr->tableSize; ++i) {
+        Orbit *orbit = rptr->orbits + i;
+        float theta = PI * i / (rptr->tableSize - 1);
+        Vec4 s = {r0, 0.0F, cosf(theta), sinf(theta)};
+        float L = r0 * s[3];
+        float t = 0.0F;
+        float h = first_step(rptr, r0);
+        float phi = 0.0F, lastPhi = 0.0F;
+        int escaped = 0;
+        orbit->start = rptr->numOrbitPts;
+        orbit->fell = 0;
+        add_point(rptr, s, phi);
+
+        while (TMAX - t > .001F) {
+            Vec2 old_ep = {s[0], s[1]};
+            t += step_orbit(rptr, L, s, &h, TMAX - t);
+            rptr->tableSteps += 1;
+            phi += atan2f(old_ep[0] * s[1] - old_ep[1] * s[0], old_ep[0] * s[0] + old_ep[1] * s[1]);
+
+            if (s[0] * s[0] + s[1] * s[1] < 1.0F) {
+                orbit->fell = 1;
+                break;
+            }
+            if (phi - lastPhi >= maxDphi) {
+                add_point(rptr, s, phi);
+                lastPhi = phi;
+            }
+            if (rptr->escape && s[0] * s[0] + s[1] * s[1] > rptr->escape * rptr->escape && s[0] * s[2] + s[1] * s[3] > 0.0F && far_field(s, TMAX - t, rptr->escape, orbit->far)) {
+                escaped = 1;
+                break;
+            }
+        }
+        if (phi != lastPhi || orbit->fell) add_point(rptr, s, phi);
+        orbit->len = rptr->numOrbitPts - orbit->start;
+        if (!escaped) {
+            orbit->far[0] = s[0] + 1000.0F * s[2];
+            orbit->far[1] = s[1] + 1000.0F * s[3];
+        }
+    }
+}
+
+
+static int table_fate(Renderer *rptr, int idx, float diskAngle, Vec2 dest) {
+    // 0 for escaping, 1 for the horizon, 2 + k for the disk on the orbit's k-th
+    // pass through its plane; dest gets the end point within the orbit plane
+    Orbit *orbit = rptr->orbits + idx;
+    Vec3 *pts = rptr->orbitPts + orbit->start;
+    float lastPhi = pts[orbit->len - 1][2];
+    float diskSlope = tanf(diskAngle);
+
+    int j = 0;
+    for (int k = 0; diskAngle + k * PI <= lastPhi; ++k) {
+        float phic = diskAngle + k * PI;
+        if (phic <= 0.0F) continue;
+
+        // binary search for the chord spanning the crossing
+        int lo = j, hi = orbit->len - 1;
+        while (hi - lo > 1) {
+            int mid = (lo + hi) / 2;
+            if (pts[mid][2] < phic) lo = mid;
+            else hi = mid;
+        }
+        j = lo;
+        if (cross_disk(pts[lo], pts[hi], diskSlope, dest)) return 2 + k;
+    }
+
+    if (orbit->fell) {
+        dest[0] = dest[1] = 0.0F;
+        return 1;
+    }
+    dest[0] = orbit->far[0];
+    dest[1] = orbit->far[1];
+    return 0;
+}
+
+
+static void lookup_finalpos(Renderer *rptr, Ray *cur, Vec3 dest) {
+    // same orbit plane as get_finalpos, but the orbit comes from the table
+    Vec3 ehat0, ehat1;
+    Vec2 ep, ev;
+    orbit_basis(cur, ehat0, ehat1, ep, ev);
+    float dot = ev[0];
+    float diskAngle = atanf(-ehat0[1] / ehat1[1]);
+    if (diskAngle < 0.0F) diskAngle += PI;
+
+    // blend the neighbouring angles when they agree on where the photon ends up
+    if (dot > 1.0F) dot = 1.0F;
+    else if (dot < -1.0F) dot = -1.0F;
+    float u = acosf(dot) / PI * (rptr->tableSize - 1);
+    int i0 = (int) u;
+    if (i0 > rptr->tableSize - 2) i0 = rptr->tableSize - 2;
+    float w = u - i0;
+    Vec2 end0, end1, end;
+    int fate0 = table_fate(rptr, i0, diskAngle, end0);
+    int fate1 = table_fate(rptr, i0 + 1, diskAngle, end1);
+    if (fate0 == fate1) {
+        for (int i = 0; i < 2; ++i) end[i] = (1.0F - w) * end0[i] + w * end1[i];
+    } else {
+        for (int i = 0; i < 2; ++i) end[i] = w < .5F ? end0[i] : end1[i];
+    }
+
+    for (int i = 0; i < 3; ++i) dest[i] = end[0] * ehat0[i] + end[1] * ehat1[i];
+}
+
+
+static Pixel shade_schwarz(Vec3 finalPos, RenderStats *stats) {
     float finalLen = vlen(finalPos);
 
     // determine final color of pixel
     Pixel out;
     if (finalLen > 100.0F) { // if photon didn't hit disk
+        stats->fates[ESCAPED] += 1;
         for (int i = 0; i < 3; ++i) {
             if (finalPos[i] > 1.0F) finalPos[i] = 1.0F;
             else if (finalPos[i] < 0.0F) finalPos[i] = 0.0F;
@@ -307,6 +678,7 @@ static Pixel render_schwarz(Ray *cur) {
         out.b = (unsigned char) 255 * finalPos[2];
 
     } else if (finalLen > 2.9F) { // photon hit accretion disk
+        stats->fates[DISK] += 1;
         float fphi = (finalPos[2] >= 0.0F ? 1.0F : -1.0F) * acos(finalPos[0] / sqrt(finalPos[0] * finalPos[0] + finalPos[2] * finalPos[2])) + PI;
         float r01 = (finalLen - 3.0F) / 3.0F;
         float fphi01 = (fphi) / PI / 2.;
@@ -316,6 +688,7 @@ static Pixel render_schwarz(Ray *cur) {
         out.b = (unsigned char) 0;
 
     } else { // photon entered black hole
+        stats->fates[HORIZON] += 1;
         out.r = (unsigned char) 0;
         out.g = (unsigned char) 0;
         out.b = (unsigned char) 0;
@@ -325,14 +698,260 @@ static Pixel render_schwarz(Ray *cur) {
 }
 
 
-Pixel render(Renderer *rptr, int px) {
-    Ray *cur = create_ray(rptr, px);
-    Pixel out = {(unsigned char) 0, (unsigned char) 0, (unsigned char) 0};
-    if (!strcmp(rptr->scene, "schwarz")) {
-        out = render_schwarz(cur);
-    } else if (!strcmp(rptr->scene, "sphere")) {
-        out = render_sphere(cur);
+static Pixel render_schwarz(Renderer *rptr, Ray *cur, RenderStats *stats) {
+    // determine final position of photon
+    Vec3 finalPos = {0.0F, 0.0F, 0.0F};
+    if (rptr->tableSize) lookup_finalpos(rptr, cur, finalPos);
+    else stats->steps += get_finalpos(rptr, cur, finalPos);
+    return shade_schwarz(finalPos, stats);
+}
+
+
+static Pixel render_kerr(Renderer *rptr, Ray *cur, RenderStats *stats) {
+    // the spinning hole's photons end up in the same places, so shade alike
+    Vec3 finalPos = {0.0F, 0.0F, 0.0F};
+    stats->steps += kerr_finalpos(rptr, cur, finalPos);
+    return shade_schwarz(finalPos, stats);
+}
+
+
+Pixel render(Renderer *rptr, int px, RenderStats *stats) {
+    Ray cur;
+    create_ray(rptr, px, &cur);
+    stats->rays += 1;
+    return rptr->sceneFn(rptr, &cur, stats);
+}
+
+
+// traces n pixels, startPx onwards or the ones listed in pxs, a packet at a
+// time, leaving where each photon ended up in finalPos
+static void packet_finalpos(Renderer *rptr, int startPx, const int *pxs, int n, Vec3 *finalPos, RenderStats *stats) {
+    Packet p;
+    Vec3 ehat0[PACKET_MAX], ehat1[PACKET_MAX];
+    int idx[PACKET_MAX];
+    p.n = 0;
+    p.escape2 = rptr->escape * rptr->escape;
+    for (int k = 0; k <= n; ++k) {
+        // set up each orbit on its own, unless it's far enough out to skip
+        if (k < n) {
+            Ray cur;
+            create_ray(rptr, pxs ? pxs[k] : startPx + k, &cur);
+            Vec2 ep, ev;
+            orbit_basis(&cur, ehat0[p.n], ehat1[p.n], ep, ev);
+            Vec4 s = {ep[0], ep[1], ev[0], ev[1]};
+            Vec2 end;
+            if (rptr->escape && far_field(s, TMAX, rptr->escape, end)) {
+                for (int j = 0; j < 3; ++j) finalPos[k][j] = end[0] * ehat0[p.n][j] + end[1] * ehat1[p.n][j];
+                continue;
+            }
+            p.e0[p.n] = ep[0];
+            p.e1[p.n] = ep[1];
+            p.v0[p.n] = ev[0];
+            p.v1[p.n] = ev[1];
+            p.L[p.n] = ep[0] * ev[1];
+            p.slope[p.n] = -ehat0[p.n][1] / ehat1[p.n][1];
+            idx[p.n++] = k;
+            if (p.n < rptr->packetWidth) continue;
+        }
+        if (!p.n) continue;
+
+        // integrate them together, finishing off the ones that left early
+        packet_trace(&p, rptr->packetWidth);
+        for (int i = 0; i < p.n; ++i) {
+            Vec2 end = {p.end0[i], p.end1[i]};
+            if (p.fate[i] == ESCAPED && p.steps[i] < PACKET_STEPS) {
+                Vec4 s = {p.end0[i], p.end1[i], p.endv0[i], p.endv1[i]};
+                if (!far_field(s, TMAX - p.steps[i] * PACKET_DT, rptr->escape, end)) {
+                    end[0] = s[0] + 1000.0F * s[2];
+                    end[1] = s[1] + 1000.0F * s[3];
+                }
+            }
+            for (int j = 0; j < 3; ++j) finalPos[idx[i]][j] = end[0] * ehat0[i][j] + end[1] * ehat1[i][j];
+            stats->steps += p.steps[i];
+        }
+        p.n = 0;
     }
-    free(cur);
-    return out;
-}
\ No newline at end of file
+    stats->rays += n;
+}
+
+
+static void render_packets(Renderer *rptr, int startPx, int numPx, Pixel *dest, RenderStats *stats) {
+    // a stack's worth of pixels at a time, shaded on their own
+    Vec3 finalPos[PACKET_CHUNK];
+    for (int first = 0; first < numPx; first += PACKET_CHUNK) {
+        int n = numPx - first < PACKET_CHUNK ? numPx - first : PACKET_CHUNK;
+        packet_finalpos(rptr, startPx + first, NULL, n, finalPos, stats);
+        for (int i = 0; i < n; ++i) dest[first + i] = shade_schwarz(finalPos[i], stats);
+    }
+}
+
+
+// Euler orbits of the black hole go through the vector units when they can
+static int use_packets(Renderer *rptr) {
+    return rptr->packetWidth && rptr->integrator == EULER && !rptr->tableSize && rptr->sceneFn == render_schwarz;
+}
+
+
+void render_span(Renderer *rptr, int startPx, int numPx, Pixel *dest, RenderStats *stats) {
+    if (use_packets(rptr)) {
+        render_packets(rptr, startPx, numPx, dest, stats);
+        return;
+    }
+    for (int i = 0; i < numPx; ++i) dest[i] = render(rptr, startPx + i, stats);
+}
+
+
+void render_list(Renderer *rptr, const int *pxs, int n, Pixel *dest, RenderStats *stats) {
+    if (use_packets(rptr)) {
+        Vec3 finalPos[PACKET_CHUNK];
+        for (int first = 0; first < n; first += PACKET_CHUNK) {
+            int num = n - first < PACKET_CHUNK ? n - first : PACKET_CHUNK;
+            packet_finalpos(rptr, 0, pxs + first, num, finalPos, stats);
+            for (int i = 0; i < num; ++i) dest[first + i] = shade_schwarz(finalPos[i], stats);
+        }
+        return;
+    }
+    for (int i = 0; i < n; ++i) dest[i] = render(rptr, pxs[i], stats);
+}
+
+
+// a coarse sample of the adaptive mode: its colour and how its photon ended
+typedef struct Sample {
+    Pixel px;
+    Fate fate;
+} Sample;
+
+
+static Fate schwarz_fate(Vec3 finalPos) {
+    float finalLen = vlen(finalPos);
+    if (finalLen <= 2.9F) return HORIZON;
+    return finalLen <= 100.0F ? DISK : ESCAPED;
+}
+
+
+// traces a scattered set of pixels, a packet at a time when the renderer can
+static void trace_samples(Renderer *rptr, const int *pxs, int n, Sample *dest, RenderStats *stats) {
+    if (use_packets(rptr)) {
+        Vec3 finalPos[PACKET_CHUNK];
+        for (int first = 0; first < n; first += PACKET_CHUNK) {
+            int num = n - first < PACKET_CHUNK ? n - first : PACKET_CHUNK;
+            packet_finalpos(rptr, 0, pxs + first, num, finalPos, stats);
+            for (int i = 0; i < num; ++i) {
+                dest[first + i].fate = schwarz_fate(finalPos[i]);
+                dest[first + i].px = shade_schwarz(finalPos[i], stats);
+            }
+        }
+        return;
+    }
+
+    for (int i = 0; i < n; ++i) {
+        Ray cur;
+        create_ray(rptr, pxs[i], &cur);
+        stats->rays += 1;
+        dest[i].fate = ESCAPED;
+        if (rptr->sceneFn == render_sphere) {
+            dest[i].px = rptr->sceneFn(rptr, &cur, stats);
+            continue;
+        }
+        Vec3 finalPos = {0.0F, 0.0F, 0.0F};
+        if (rptr->sceneFn == render_kerr) stats->steps += kerr_finalpos(rptr, &cur, finalPos);
+        else if (rptr->tableSize) lookup_finalpos(rptr, &cur, finalPos);
+        else stats->steps += get_finalpos(rptr, &cur, finalPos);
+        dest[i].fate = schwarz_fate(finalPos);
+        dest[i].px = shade_schwarz(finalPos, stats);
+    }
+}
+
+
+static int differ(Sample *a, Sample *b, int threshold) {
+    if (a->fate != b->fate) return 1;
+    return abs(a->px.r - b->px.r) > threshold || abs(a->px.g - b->px.g) > threshold || abs(a->px.b - b->px.b) > threshold;
+}
+
+
+// a cell can be interpolated when its four corners share a fate and colour
+static int agree(Sample *corners[4], int threshold) {
+    for (int i = 1; i < 4; ++i) {
+        if (differ(corners[0], corners[i], threshold)) return 0;
+    }
+    return 1;
+}
+
+
+static unsigned char lerp2(unsigned char c00, unsigned char c10, unsigned char c01, unsigned char c11, float fx, float fy) {
+    float top = c00 + (c10 - c00) * fx;
+    float bot = c01 + (c11 - c01) * fx;
+    return (unsigned char) (top + (bot - top) * fy + .5F);
+}
+
+
+// refines one block of a tile, at most BLOCK + 1 pixels wide: samples every
+// GRID pixels (and the block's last row and column), then traces every pixel
+// of the cells whose corners disagree and interpolates the rest
+static void refine_block(Renderer *rptr, int x0, int y0, int w, int h, Pixel *dest, RenderStats *stats) {
+    Sample rowA[BLOCK / GRID + 2], rowB[BLOCK / GRID + 2];
+    int xs[BLOCK / GRID + 2], trace[BLOCK / GRID + 1];
+    int pxs[(BLOCK + 1) * (GRID + 1)];
+    Sample traced[(BLOCK + 1) * (GRID + 1)];
+    int numCols = (w - 2) / GRID + 2;
+    for (int k = 0; k < numCols; ++k) xs[k] = k * GRID < w - 1 ? k * GRID : w - 1;
+
+    Sample *top = rowA, *bot = rowB;
+    for (int k = 0; k < numCols; ++k) pxs[k] = y0 * rptr->width + x0 + xs[k];
+    trace_samples(rptr, pxs, numCols, top, stats);
+
+    for (int ytop = 0; ytop < h - 1; ytop += GRID) {
+        int ybot = ytop + GRID < h - 1 ? ytop + GRID : h - 1;
+        for (int k = 0; k < numCols; ++k) pxs[k] = (y0 + ybot) * rptr->width + x0 + xs[k];
+        trace_samples(rptr, pxs, numCols, bot, stats);
+        for (int k = 0; k < numCols - 1; ++k) {
+            Sample *corners[4] = {top + k, top + k + 1, bot + k, bot + k + 1};
+            trace[k] = !agree(corners, rptr->refine);
+        }
+
+        // the bottom row of samples is the next cell row's top, except the last
+        int yend = ybot == h - 1 ? ybot : ybot - 1;
+        int n = 0;
+        for (int y = ytop; y <= yend; ++y) {
+            Pixel *row = dest + y * rptr->width;
+            float fy = (y - ytop) / (float) (ybot - ytop);
+            for (int k = 0; k < numCols - 1; ++k) {
+                int xl = xs[k], xr = xs[k + 1];
+                int last = k == numCols - 2 ? xr : xr - 1;
+                for (int x = xl; x <= last; ++x) {
+                    if (trace[k]) {
+                        pxs[n++] = (y0 + y) * rptr->width + x0 + x;
+                        continue;
+                    }
+                    float fx = (x - xl) / (float) (xr - xl);
+                    row[x].r = lerp2(top[k].px.r, top[k + 1].px.r, bot[k].px.r, bot[k + 1].px.r, fx, fy);
+                    row[x].g = lerp2(top[k].px.g, top[k + 1].px.g, bot[k].px.g, bot[k + 1].px.g, fx, fy);
+                    row[x].b = lerp2(top[k].px.b, top[k + 1].px.b, bot[k].px.b, bot[k + 1].px.b, fx, fy);
+                }
+            }
+        }
+
+        // trace the disagreeing cells of the whole cell row together
+        trace_samples(rptr, pxs, n, traced, stats);
+        for (int i = 0; i < n; ++i) dest[pxs[i] - y0 * rptr->width - x0] = traced[i].px;
+
+        Sample *tmp = top;
+        top = bot;
+        bot = tmp;
+    }
+}
+
+
+void render_refine(Renderer *rptr, int x0, int y0, int w, int h, Pixel *dest, RenderStats *stats) {
+    // too thin to have cells, trace it all
+    if (w < 2 || h < 2) {
+        for (int y = 0; y < h; ++y) render_span(rptr, (y0 + y) * rptr->width + x0, w, dest + y * rptr->width, stats);
+        return;
+    }
+    for (int bx = 0; bx < w; bx += BLOCK) {
+        // a last block one pixel wide would have no cells, fold it into this one
+        int bw = w - bx <= BLOCK + 1 ? w - bx : BLOCK;
+        refine_block(rptr, x0 + bx, y0, bw, h, dest + bx, stats);
+        if (bw > BLOCK) break;
+    }
+}
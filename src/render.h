@@ -4,24 +4,75 @@
 #include "tga.h"
 #include "args.h"
 
+#define TMAX 37.5F // affine length every photon is followed for
+
 
 typedef float Mat4[4][4];
 typedef float Vec2[2];
 typedef float Vec3[3];
 typedef float Vec4[4];
+typedef struct Ray {
+    Vec3 pos;
+    Vec3 dir;
+} Ray;
+typedef enum Integrator {
+    EULER,
+    RK4,
+    RK45,
+    LEAPFROG
+} Integrator;
+typedef enum Fate {
+    ESCAPED,
+    HORIZON,
+    DISK
+} Fate;
+typedef struct RenderStats {
+    long rays;
+    long steps;
+    long fates[3]; // rays of the black hole by how they ended, indexed by Fate
+} RenderStats;
+typedef struct Orbit {
+    int start;  // first of its points in orbitPts
+    int len;
+    int fell;   // ended in the horizon rather than escaping
+    Vec2 far;   // where an escaping photon is headed
+} Orbit;
 typedef struct Renderer {
     float pos[3];
     float dir[3];
     float fov;
     int width;
     int height;
+    float aspect;
+    float tana; // tan of half the fov
     Mat4 view;
-    char *scene;
+    Pixel (*sceneFn)(struct Renderer *rptr, Ray *cur, RenderStats *stats);
+    Integrator integrator;
+    float tol;
+    float stepScale; // step per unit radius for rk4 and leapfrog, tol^(1/4)
+    int packetWidth; // rays per SIMD packet, 0 for the scalar path
+    float escape; // radius past which outbound photons are finished analytically, 0 for never
+    float spin; // a / M of the kerr scene
+    int refine; // colour difference that makes a coarse cell trace every pixel, -1 traces them all
+
+    // per-frame trajectory table, indexed by emission angle
+    int tableSize;
+    long tableSteps;
+    Orbit *orbits;
+    Vec3 *orbitPts; // e0, e1, swept angle
+    int numOrbitPts;
+    int capOrbitPts;
 } Renderer;
 
 
 Renderer *render_init(KerrArgs *args);
-Pixel render(Renderer *rptr, int px);
+void render_update(Renderer *rptr, KerrArgs *args);
+void render_free(Renderer *rptr);
+Pixel render(Renderer *rptr, int px, RenderStats *stats);
+void render_span(Renderer *rptr, int startPx, int numPx, Pixel *dest, RenderStats *stats);
+void render_list(Renderer *rptr, const int *pxs, int n, Pixel *dest, RenderStats *stats); // n scattered pixels, into dest in the same order
+void render_refine(Renderer *rptr, int x0, int y0, int w, int h, Pixel *dest, RenderStats *stats);
+int far_field(Vec4 s, float left, float radius, Vec2 dest); // finishes an outbound planar orbit analytically
 
 
 #endif
\ No newline at end of file
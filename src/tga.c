@@ -1,43 +1,429 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
 #include "tga.h"
+#include "gif.h"
 
 
-FILE *jgr_open(const char *fileName) {
-    FILE *jgr = fopen(fileName, "w");
-    char header[] = "newgraph\nxaxis size 4.8 nodraw\nyaxis size 2.7 nodraw\n\n";
-    if (jgr) fwrite(header, (int) strlen(header), 1, jgr);
-    return jgr;
+#define JGR_HEADER "newgraph\nxaxis size 4.8 nodraw\nyaxis size 2.7 nodraw\n\n"
+#define IMG_BATCH 64 // chunks handed to a single writev
+
+
+// every channel value as jgraph gets it, v / 255 to two decimals, plus
+// the same in hundredths for telling apart colours that print differently
+static char channels[256][4];
+static int hundredths[256];
+static pthread_once_t channelsOnce = PTHREAD_ONCE_INIT;
+
+
+static void jgr_channels() {
+    for (int v = 0; v < 256; ++v) {
+        char num[8];
+        snprintf(num, sizeof(num), "%.2f", v / 255.);
+        memcpy(channels[v], num, 4);
+        hundredths[v] = (num[0] - '0') * 100 + (num[2] - '0') * 10 + (num[3] - '0');
+    }
+}
+
+
+static int digits(int val) {
+    int n = 1;
+    while (val >= 10) {
+        val /= 10;
+        n += 1;
+    }
+    return n;
+}
+
+
+static char *put_int(char *dest, int val) {
+    // coordinates are never negative
+    char rev[12];
+    int n = 0;
+    do {
+        rev[n++] = '0' + val % 10;
+        val /= 10;
+    } while (val);
+    while (n) *dest++ = rev[--n];
+    return dest;
+}
+
+
+static char *jgr_rect(char *dest, int x0, int y0, int x1, int y1, Pixel px) {
+    // newline poly pts 0 0  1 0  1 1  0 1 color 1.00 1.00 1.00
+    memcpy(dest, "newline poly pts ", 17);
+    dest = put_int(dest + 17, x0);
+    *dest++ = ' ';
+    dest = put_int(dest, y0);
+    memcpy(dest, "  ", 2);
+    dest = put_int(dest + 2, x1);
+    *dest++ = ' ';
+    dest = put_int(dest, y0);
+    memcpy(dest, "  ", 2);
+    dest = put_int(dest + 2, x1);
+    *dest++ = ' ';
+    dest = put_int(dest, y1);
+    memcpy(dest, "  ", 2);
+    dest = put_int(dest + 2, x0);
+    *dest++ = ' ';
+    dest = put_int(dest, y1);
+    memcpy(dest, " color ", 7);
+    memcpy(dest + 7, channels[px.r], 4);
+    dest[11] = ' ';
+    memcpy(dest + 12, channels[px.g], 4);
+    dest[16] = ' ';
+    memcpy(dest + 17, channels[px.b], 4);
+    dest[21] = '\n';
+    return dest + 22;
+}
+
+
+long jgr_bound(int width, int height, int rows) {
+    // one rectangle per pixel with the widest coordinates the frame has
+    long line = 49 + 4 * (digits(width) + digits(height));
+    return line * width * rows;
+}
+
+
+// a run of same-coloured pixels, possibly grown down over several rows
+typedef struct Span {
+    int x0, x1;
+    int top;
+    int key;
+    Pixel px;
+} Span;
+
+
+static char *jgr_merge(char *dest, const Pixel *buf, int width, int height, int y0, int y1, int merge, long *prims) {
+    // merge 1 emits one rectangle per run in a row, merge 2 also
+    // stacks identical runs from consecutive rows into one rectangle
+    Span *open = malloc(width * sizeof(Span));
+    Span *next = malloc(width * sizeof(Span));
+    int numOpen = 0;
+
+    for (int y = y0; y <= y1; ++y) {
+        int numNext = 0;
+        int j = 0;
+        const Pixel *row = buf + y * width;
+        for (int x = 0; y < y1 && x < width;) {
+            // find the run starting at x
+            int key = (hundredths[row[x].r] << 16) | (hundredths[row[x].g] << 8) | hundredths[row[x].b];
+            Span run = {x, x + 1, y, key, row[x]};
+            while (run.x1 < width) {
+                const Pixel *px = row + run.x1;
+                if (((hundredths[px->r] << 16) | (hundredths[px->g] << 8) | hundredths[px->b]) != key) break;
+                run.x1 += 1;
+            }
+            x = run.x1;
+
+            if (merge < 2) {
+                dest = jgr_rect(dest, run.x0, height - 1 - y, run.x1, height - y, run.px);
+                *prims += 1;
+                continue;
+            }
+
+            // extend the matching rectangle from the row above, closing any it passed
+            while (j < numOpen && open[j].x0 < run.x0) {
+                dest = jgr_rect(dest, open[j].x0, height - y, open[j].x1, height - open[j].top, open[j].px);
+                *prims += 1;
+                j += 1;
+            }
+            if (j < numOpen && open[j].x0 == run.x0 && open[j].x1 == run.x1 && open[j].key == key) {
+                run.top = open[j].top;
+                j += 1;
+            }
+            next[numNext++] = run;
+        }
+
+        // whatever wasn't continued ends on the row above
+        for (; j < numOpen; ++j) {
+            dest = jgr_rect(dest, open[j].x0, height - y, open[j].x1, height - open[j].top, open[j].px);
+            *prims += 1;
+        }
+        Span *tmp = open;
+        open = next;
+        next = tmp;
+        numOpen = numNext;
+    }
+
+    free(open);
+    free(next);
+    return dest;
+}
+
+
+long jgr_encode(char *dest, const Pixel *buf, int width, int height, int y0, int y1, int merge, long *prims) {
+    pthread_once(&channelsOnce, jgr_channels);
+    char *end = dest;
+    if (merge) {
+        end = jgr_merge(dest, buf, width, height, y0, y1, merge, prims);
+    } else {
+        // a unit square per pixel, jgraph's y axis pointing up
+        for (int y = y0; y < y1; ++y) {
+            const Pixel *row = buf + y * width;
+            for (int x = 0; x < width; ++x) end = jgr_rect(end, x, height - 1 - y, x + 1, height - y, row[x]);
+        }
+        *prims += (long) width * (y1 - y0);
+    }
+    return end - dest;
+}
+
+
+static long write_all(int fd, struct iovec *iov, int count) {
+    long written = 0;
+    while (count > 0) {
+        ssize_t n = writev(fd, iov, count);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return -1;
+        written += n;
+
+        // skip whatever went out, carrying on from inside a partly written chunk
+        while (count > 0 && (size_t) n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov += 1;
+            count -= 1;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *) iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return written;
+}
+
+
+long img_flush(int fd, struct iovec head, const struct iovec *chunks, int numChunks, struct iovec tail) {
+    // head and tail ride along with the first and last batch of chunks
+    struct iovec batch[IMG_BATCH];
+    int count = 0;
+    long written = 0;
+    if (head.iov_len) batch[count++] = head;
+    for (int i = 0; i <= numChunks; ++i) {
+        struct iovec next = i < numChunks ? chunks[i] : tail;
+        if (next.iov_len) batch[count++] = next;
+        if (count == IMG_BATCH || (i == numChunks && count)) {
+            long n = write_all(fd, batch, count);
+            if (n < 0) return -1;
+            written += n;
+            count = 0;
+        }
+    }
+    return written;
+}
+
+
+long jgr_flush(const char *fileName, const struct iovec *chunks, int numChunks, int width, int height, ImgOpts *opts) {
+    (void) width;
+    (void) height;
+    (void) opts;
+    int fd = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) return 0;
+    struct iovec head = {(void *) JGR_HEADER, strlen(JGR_HEADER)};
+    long written = img_flush(fd, head, chunks, numChunks, (struct iovec) {NULL, 0});
+    if (close(fd) || written < 0) return 0;
+    return written;
+}
+
+
+long jgr_save(const char *fileName, const Pixel *buf, int width, int height, ImgOpts *opts) {
+    // the whole frame is formatted into one buffer and goes out in one write
+    char *text = malloc(jgr_bound(width, height, height));
+    if (!text) return 0;
+    struct iovec chunk = {text, jgr_encode(text, buf, width, height, 0, height, opts->merge, &(opts->prims))};
+    long written = jgr_flush(fileName, &chunk, 1, width, height, opts);
+    free(text);
+    return written;
 }
 
 
-void jgr_close(FILE *img) {
-    if (img) fclose(img);
+static long jgr_encode_band(char *dest, const Pixel *buf, int width, int height, int y0, int y1, const ImgOpts *opts, long *prims) {
+    return jgr_encode(dest, buf, width, height, y0, y1, opts->merge, prims);
 }
 
 
-int jgr_write(FILE *img, const Pixel *buf, int numPx, int startPx, int width) {
-    // newline poly pcfill 255 255 255 pts 0 0  1 0  1 1  0 1 color 255 255 255
-    int written = 0;
-    for (int i = 0; i < numPx; ++i) {
-        char line[100];
-        int pxID = startPx-i;
-        int x = width-1-pxID%width;
-        int y = pxID/width;
-        int line_len = sprintf(line, "newline poly pts %d %d  %d %d  %d %d  %d %d color %.2f %.2f %.2f\n",
-            x,
-            y,
-            x+1,
-            y,
-            x+1,
-            y+1,
-            x,
-            y+1,
-            ((double) buf[i].r) / 255.,
-            ((double) buf[i].g) / 255.,
-            ((double) buf[i].b) / 255.
-        );
-        written += fwrite(line, 1, line_len, img);
+static void put16(unsigned char *dest, int val) {
+    // little endian, as TGA wants it
+    dest[0] = val & 0xFF;
+    dest[1] = (val >> 8) & 0xFF;
+}
+
+
+static void put32(unsigned char *dest, unsigned int val) {
+    // big endian, as PNG wants it
+    dest[0] = (val >> 24) & 0xFF;
+    dest[1] = (val >> 16) & 0xFF;
+    dest[2] = (val >> 8) & 0xFF;
+    dest[3] = val & 0xFF;
+}
+
+
+long tga_save(const char *fileName, const Pixel *buf, int width, int height, ImgOpts *opts) {
+    (void) opts;
+    // uncompressed true color, origin in the top left so rows go out as rendered
+    FILE *tga = fopen(fileName, "wb");
+    if (!tga) return 0;
+    unsigned char header[18] = {0};
+    header[2] = 2;
+    put16(header + 12, width);
+    put16(header + 14, height);
+    header[16] = 24;
+    header[17] = 0x20;
+
+    // Pixel is already laid out as BGR, so the buffer goes out untouched
+    int written = fwrite(header, 1, sizeof(header), tga);
+    written += fwrite(buf, sizeof(Pixel), width * height, tga) * sizeof(Pixel);
+    fclose(tga);
+    return written;
+}
+
+
+long ppm_save(const char *fileName, const Pixel *buf, int width, int height, ImgOpts *opts) {
+    (void) opts;
+    FILE *ppm = fopen(fileName, "wb");
+    if (!ppm) return 0;
+    int written = fprintf(ppm, "P6\n%d %d\n255\n", width, height);
+
+    unsigned char *row = malloc(3 * width);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            const Pixel *px = buf + y * width + x;
+            row[3 * x] = px->r;
+            row[3 * x + 1] = px->g;
+            row[3 * x + 2] = px->b;
+        }
+        written += fwrite(row, 1, 3 * width, ppm);
     }
+    free(row);
+    fclose(ppm);
+    return written;
+}
+
+
+static unsigned int crc32(const unsigned int *table, unsigned int crc, const unsigned char *data, long len) {
+    for (long i = 0; i < len; ++i) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+
+static int png_chunk(FILE *png, const unsigned int *table, const char *type, const unsigned char *data, long len) {
+    // length, type, data, then a crc over type and data
+    unsigned char head[8];
+    unsigned char tail[4];
+    put32(head, len);
+    memcpy(head + 4, type, 4);
+    unsigned int crc = crc32(table, 0xFFFFFFFFU, head + 4, 4);
+    crc = crc32(table, crc, data, len) ^ 0xFFFFFFFFU;
+    put32(tail, crc);
+
+    int written = fwrite(head, 1, 8, png);
+    written += fwrite(data, 1, len, png);
+    written += fwrite(tail, 1, 4, png);
     return written;
-}
\ No newline at end of file
+}
+
+
+long png_save(const char *fileName, const Pixel *buf, int width, int height, ImgOpts *opts) {
+    (void) opts;
+    FILE *png = fopen(fileName, "wb");
+    if (!png) return 0;
+
+    unsigned int table[256];
+    for (unsigned int i = 0; i < 256; ++i) {
+        unsigned int c = i;
+        for (int k = 0; k < 8; ++k) c = c & 1 ? 0xEDB88320U ^ (c >> 1) : c >> 1;
+        table[i] = c;
+    }
+
+    // signature and header: 8 bit RGB, no interlacing
+    unsigned char sig[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    int written = fwrite(sig, 1, 8, png);
+    unsigned char ihdr[13] = {0};
+    put32(ihdr, width);
+    put32(ihdr + 4, height);
+    ihdr[8] = 8;
+    ihdr[9] = 2;
+    written += png_chunk(png, table, "IHDR", ihdr, 13);
+
+    // zlib stream made of stored deflate blocks, each scanline prefixed with filter type 0
+    long rawLen = (long) height * (1 + 3 * width);
+    long numBlocks = (rawLen + 65534) / 65535;
+    long zlen = 2 + 5 * numBlocks + rawLen + 4;
+    unsigned char *zbuf = malloc(zlen);
+    unsigned char *raw = zbuf + 2 + 5 * numBlocks;
+    unsigned char *cur = raw;
+    for (int y = 0; y < height; ++y) {
+        *cur++ = 0;
+        for (int x = 0; x < width; ++x) {
+            const Pixel *px = buf + y * width + x;
+            *cur++ = px->r;
+            *cur++ = px->g;
+            *cur++ = px->b;
+        }
+    }
+
+    //     adler32 of the uncompressed data
+    unsigned int a = 1, b = 0;
+    for (long i = 0; i < rawLen; ++i) {
+        a = (a + raw[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+
+    //     interleave block headers by sliding each block's data into place
+    zbuf[0] = 0x78;
+    zbuf[1] = 0x01;
+    unsigned char *dest = zbuf + 2;
+    for (long i = 0; i < numBlocks; ++i) {
+        long start = i * 65535;
+        int len = rawLen - start < 65535 ? rawLen - start : 65535;
+        dest[0] = i == numBlocks - 1;
+        put16(dest + 1, len);
+        put16(dest + 3, ~len & 0xFFFF);
+        memmove(dest + 5, raw + start, len);
+        dest += 5 + len;
+    }
+    put32(dest, (b << 16) | a);
+    written += png_chunk(png, table, "IDAT", zbuf, zlen);
+    written += png_chunk(png, table, "IEND", NULL, 0);
+
+    free(zbuf);
+    fclose(png);
+    return written;
+}
+
+
+// throws the frame away, for timing the renderer on its own
+long null_save(const char *fileName, const Pixel *buf, int width, int height, ImgOpts *opts) {
+    (void) fileName;
+    (void) buf;
+    (void) opts;
+    return (long) width * height * sizeof(Pixel);
+}
+
+
+ImgWriter img_writer(const char *format) {
+    if (!strcmp(format, "jgr")) return jgr_save;
+    if (!strcmp(format, "tga")) return tga_save;
+    if (!strcmp(format, "ppm")) return ppm_save;
+    if (!strcmp(format, "png")) return png_save;
+    if (!strcmp(format, "gif")) return gif_save;
+    if (!strcmp(format, "none")) return null_save;
+    return NULL;
+}
+
+
+static const ImgEncoder JGR_BANDS = {jgr_bound, jgr_encode_band, jgr_flush, true};
+static const ImgEncoder JGR_WHOLE = {jgr_bound, jgr_encode_band, jgr_flush, false};
+static const ImgEncoder GIF = {gif_bound, gif_encode, gif_flush, false};
+
+
+const ImgEncoder *img_encoder(const char *format, const ImgOpts *opts) {
+    // stacking rectangles across rows needs the whole frame in one band
+    if (!strcmp(format, "jgr")) return opts->merge == 2 ? &JGR_WHOLE : &JGR_BANDS;
+    if (!strcmp(format, "gif")) return &GIF;
+    return NULL;
+}
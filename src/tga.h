@@ -2,7 +2,9 @@
 #define TGA_H
 
 
+#include <stdbool.h>
 #include <stdio.h>
+#include <sys/uio.h>
 
 
 typedef struct Pixel {
@@ -10,9 +12,49 @@ typedef struct Pixel {
 } Pixel;
 
 
-FILE *jgr_open(const char *fileName);
-void jgr_close(FILE *img);
-int jgr_write(FILE *img, const Pixel *buf, int numPx, int startPx, int width);
+// encoder settings, plus running totals the encoders keep
+typedef struct ImgOpts {
+    int merge;
+    int delay; // gif frame delay in hundredths of a second
+    int loop; // gif repeats, 0 forever, -1 none
+    long prims;
+    long frames; // written so far to a format that keeps every frame in one file
+} ImgOpts;
+
+
+// writes a whole width x height frame, rows top to bottom
+typedef long (*ImgWriter)(const char *fileName, const Pixel *buf, int width, int height, ImgOpts *opts);
+
+
+// a format whose frames the render threads encode into memory, leaving the
+// writer only the I/O; with bands a frame may be split by rows, and each band
+// encoded on its own into at most bound(width, height, rows) bytes
+typedef struct ImgEncoder {
+    long (*bound)(int width, int height, int rows);
+    long (*encode)(char *dest, const Pixel *buf, int width, int height, int y0, int y1, const ImgOpts *opts, long *prims);
+    long (*flush)(const char *fileName, const struct iovec *chunks, int numChunks, int width, int height, ImgOpts *opts);
+    bool bands;
+} ImgEncoder;
+
+
+// formats rows [y0, y1) of a frame as jgraph rectangles into dest, which
+// holds at least jgr_bound(width, height, y1 - y0) bytes, and returns the
+// length; bands formatted apart and joined match the whole frame unless
+// merge 2 would have stacked rectangles across them
+long jgr_encode(char *dest, const Pixel *buf, int width, int height, int y0, int y1, int merge, long *prims);
+long jgr_bound(int width, int height, int rows);
+// writes the jgraph header and then the formatted chunks in order
+long jgr_flush(const char *fileName, const struct iovec *chunks, int numChunks, int width, int height, ImgOpts *opts);
+// writes head, chunks and tail to fd in order, in as few writev calls as it can
+long img_flush(int fd, struct iovec head, const struct iovec *chunks, int numChunks, struct iovec tail);
+
+long jgr_save(const char *fileName, const Pixel *buf, int width, int height, ImgOpts *opts);
+long tga_save(const char *fileName, const Pixel *buf, int width, int height, ImgOpts *opts);
+long ppm_save(const char *fileName, const Pixel *buf, int width, int height, ImgOpts *opts);
+long png_save(const char *fileName, const Pixel *buf, int width, int height, ImgOpts *opts);
+long null_save(const char *fileName, const Pixel *buf, int width, int height, ImgOpts *opts);
+ImgWriter img_writer(const char *format);
+const ImgEncoder *img_encoder(const char *format, const ImgOpts *opts);
 
 
 #endif
\ No newline at end of file
@@ -0,0 +1,215 @@
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "topo.h"
+
+
+static bool read_line(const char *path, char *line, int size) {
+    FILE *f = fopen(path, "r");
+    if (!f) return false;
+    bool ok = fgets(line, size, f) != NULL;
+    fclose(f);
+    return ok;
+}
+
+
+// marks the cpus of a list like "0-3,8-11" that are also usable, and
+// not claimed yet, as taken by this node
+static int take_cpus(Topology *topo, const char *list, bool *usable) {
+    int taken = 0;
+    const char *cur = list;
+    while (*cur && *cur != '\n') {
+        char *end;
+        int lo = strtol(cur, &end, 10);
+        int hi = lo;
+        if (end == cur) break;
+        if (*end == '-') hi = strtol(end + 1, &end, 10);
+        for (int c = lo; c <= hi && c < TOPO_CPUS; ++c) {
+            if (c < 0 || !usable[c]) continue;
+            usable[c] = false;
+            topo->cpus[topo->numCpus++] = c;
+            taken += 1;
+        }
+        cur = *end == ',' ? end + 1 : end;
+    }
+    return taken;
+}
+
+
+static double cgroup_quota(const char *root) {
+    char path[1024], line[256];
+
+    // cgroup v2: the process's own group, or the root of a container's namespace
+    char group[512] = "";
+    snprintf(path, sizeof(path), "%s/proc/self/cgroup", root);
+    FILE *f = fopen(path, "r");
+    while (f && fgets(line, sizeof(line), f)) {
+        if (!strncmp(line, "0::", 3)) {
+            snprintf(group, sizeof(group), "%s", line + 3);
+            group[strcspn(group, "\n")] = '\0';
+        }
+    }
+    if (f) fclose(f);
+    const char *v2[2] = {group, ""};
+    for (int i = 0; i < 2; ++i) {
+        snprintf(path, sizeof(path), "%s/sys/fs/cgroup%s/cpu.max", root, !strcmp(v2[i], "/") ? "" : v2[i]);
+        long quota, period;
+        if (read_line(path, line, sizeof(line))) {
+            if (sscanf(line, "%ld %ld", &quota, &period) == 2 && quota > 0 && period > 0) return quota / (double) period;
+            return 0.0;
+        }
+    }
+
+    // cgroup v1
+    const char *v1[2] = {"cpu", "cpu,cpuacct"};
+    for (int i = 0; i < 2; ++i) {
+        long quota, period;
+        snprintf(path, sizeof(path), "%s/sys/fs/cgroup/%s/cpu.cfs_quota_us", root, v1[i]);
+        if (!read_line(path, line, sizeof(line)) || sscanf(line, "%ld", &quota) != 1) continue;
+        snprintf(path, sizeof(path), "%s/sys/fs/cgroup/%s/cpu.cfs_period_us", root, v1[i]);
+        if (!read_line(path, line, sizeof(line)) || sscanf(line, "%ld", &period) != 1) continue;
+        return quota > 0 && period > 0 ? quota / (double) period : 0.0;
+    }
+    return 0.0;
+}
+
+
+static int cmp_int(const void *a, const void *b) {
+    return *(const int *) a - *(const int *) b;
+}
+
+
+void topo_detect(Topology *topo, const char *root, const int *allowed, int numAllowed) {
+    bool usable[TOPO_CPUS] = {false};
+    if (allowed) {
+        for (int i = 0; i < numAllowed; ++i) {
+            if (allowed[i] >= 0 && allowed[i] < TOPO_CPUS) usable[allowed[i]] = true;
+        }
+    } else {
+        cpu_set_t set;
+        if (!sched_getaffinity(0, sizeof(set), &set)) {
+            for (int c = 0; c < TOPO_CPUS; ++c) usable[c] = CPU_ISSET(c, &set);
+        } else {
+            long online = sysconf(_SC_NPROCESSORS_ONLN);
+            for (int c = 0; c < online && c < TOPO_CPUS; ++c) usable[c] = true;
+        }
+    }
+
+    // numa nodes in id order, each with the usable cpus it holds
+    int ids[TOPO_NODES];
+    int numIds = 0;
+    char path[1024], line[4096];
+    snprintf(path, sizeof(path), "%s/sys/devices/system/node", root);
+    DIR *dir = opendir(path);
+    struct dirent *entry;
+    while (dir && (entry = readdir(dir)) && numIds < TOPO_NODES) {
+        int id;
+        if (sscanf(entry->d_name, "node%d", &id) == 1) ids[numIds++] = id;
+    }
+    if (dir) closedir(dir);
+    qsort(ids, numIds, sizeof(int), cmp_int);
+
+    topo->numCpus = 0;
+    topo->numNodes = 0;
+    for (int i = 0; i < numIds; ++i) {
+        snprintf(path, sizeof(path), "%s/sys/devices/system/node/node%d/cpulist", root, ids[i]);
+        if (!read_line(path, line, sizeof(line))) continue;
+        int start = topo->numCpus;
+        if (!take_cpus(topo, line, usable)) continue;
+        topo->nodes[topo->numNodes] = ids[i];
+        topo->nodeStart[topo->numNodes++] = start;
+    }
+
+    // without numa information, or for cpus it left out, one more group
+    int start = topo->numCpus;
+    for (int c = 0; c < TOPO_CPUS; ++c) {
+        if (usable[c]) topo->cpus[topo->numCpus++] = c;
+    }
+    if (topo->numCpus > start || !topo->numCpus) {
+        if (topo->numNodes == TOPO_NODES) {
+            topo->numNodes -= 1;
+        } else {
+            topo->nodes[topo->numNodes] = topo->numNodes ? -1 : 0;
+            topo->nodeStart[topo->numNodes] = start;
+        }
+        topo->numNodes += 1;
+    }
+    topo->nodeStart[topo->numNodes] = topo->numCpus;
+    topo->quota = cgroup_quota(root);
+}
+
+
+int topo_threads(const Topology *topo) {
+    int threads = topo->numCpus > 0 ? topo->numCpus : 1;
+    // a fractional quota rounds down, since the throttled part would only stall
+    if (topo->quota > 0.0 && topo->quota < threads) threads = topo->quota >= 1.0 ? (int) topo->quota : 1;
+    return threads;
+}
+
+
+int topo_place(const Topology *topo, int numThreads, const char *bind, Placement *out) {
+    if (!strcmp(bind, "none") || !topo->numCpus) {
+        for (int i = 0; i < numThreads; ++i) out[i] = (Placement) {0, -1, -1};
+        return 1;
+    }
+
+    // workers per node in proportion to its cpus, the rest handed out in turn
+    int count[TOPO_NODES];
+    int given = 0;
+    for (int n = 0; n < topo->numNodes; ++n) {
+        count[n] = numThreads * (topo->nodeStart[n + 1] - topo->nodeStart[n]) / topo->numCpus;
+        given += count[n];
+    }
+    for (int n = 0; given < numThreads; n = (n + 1) % topo->numNodes) {
+        if (topo->nodeStart[n + 1] == topo->nodeStart[n]) continue;
+        count[n] += 1;
+        given += 1;
+    }
+
+    int groups = 0;
+    int w = 0;
+    for (int n = 0; n < topo->numNodes; ++n) {
+        if (!count[n]) continue;
+        int nodeCpus = topo->nodeStart[n + 1] - topo->nodeStart[n];
+        for (int k = 0; k < count[n]; ++k) {
+            int cpu = strcmp(bind, "core") ? -1 : topo->cpus[topo->nodeStart[n] + k % nodeCpus];
+            out[w++] = (Placement) {groups, topo->nodes[n], cpu};
+        }
+        groups += 1;
+    }
+    return groups;
+}
+
+
+bool topo_spawn(const Topology *topo, Placement *place, pthread_t *tid, void *(*fn)(void *), void *arg) {
+    if (place->node < 0 && place->cpu < 0) {
+        pthread_create(tid, NULL, fn, arg);
+        return true;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (place->cpu >= 0) {
+        CPU_SET(place->cpu, &set);
+    } else {
+        for (int n = 0; n < topo->numNodes; ++n) {
+            if (topo->nodes[n] != place->node) continue;
+            for (int k = topo->nodeStart[n]; k < topo->nodeStart[n + 1]; ++k) CPU_SET(topo->cpus[k], &set);
+        }
+    }
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &set);
+    bool pinned = !pthread_create(tid, &attr, fn, arg);
+    pthread_attr_destroy(&attr);
+    if (!pinned) {
+        place->node = -1;
+        place->cpu = -1;
+        pthread_create(tid, NULL, fn, arg);
+    }
+    return pinned;
+}
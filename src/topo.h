@@ -0,0 +1,47 @@
+#ifndef TOPO_H
+#define TOPO_H
+
+
+#include <pthread.h>
+#include <stdbool.h>
+
+#define TOPO_CPUS 1024 // as many as a cpu_set_t holds
+#define TOPO_NODES 16
+
+
+// the cpus this process may run on, grouped by numa node
+typedef struct Topology {
+    int numCpus;
+    int cpus[TOPO_CPUS]; // node by node
+    int numNodes;
+    int nodes[TOPO_NODES]; // node ids
+    int nodeStart[TOPO_NODES + 1]; // node i has cpus[nodeStart[i]] up to cpus[nodeStart[i + 1]]
+    double quota; // cgroup cpu limit in cpus, 0 for none
+} Topology;
+
+
+// where one worker runs: its group of workers sharing a node, and the
+// node and cpu it is pinned to (-1 where it isn't)
+typedef struct Placement {
+    int group;
+    int node;
+    int cpu;
+} Placement;
+
+
+// reads the cpus the process may use, their numa nodes under root/sys and the
+// cgroup cpu quota; root is "" outside of tests, where allowed can also stand
+// in for the affinity mask
+void topo_detect(Topology *topo, const char *root, const int *allowed, int numAllowed);
+// threads to run when asked to pick: every usable cpu, within the quota
+int topo_threads(const Topology *topo);
+// places numThreads workers when binding none, to cores or to nodes, in
+// proportion to each node's cpus; returns the number of groups
+int topo_place(const Topology *topo, int numThreads, const char *bind, Placement *out);
+// starts fn on a thread pinned to the placement's cpu, or any of its node's;
+// if the scheduler won't have that, the thread runs unpinned, the placement
+// is cleared and it returns false
+bool topo_spawn(const Topology *topo, Placement *place, pthread_t *tid, void *(*fn)(void *), void *arg);
+
+
+#endif
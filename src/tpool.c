@@ -1,44 +1,118 @@
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
-#include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include "args.h"
 #include "tga.h"
 #include "render.h"
+#include "jobs.h"
+#include "topo.h"
+#include "manifest.h"
+#include "tpool.h"
 
+#define CACHE_LINE 64
+#define REFINE_TILE 32 // tile size when refining without -g
+#define MAX_DEPTH 64 // most frames automatically kept in flight
+#define CONVERT_CMD "./jgraph -P %s | ps2pdf - | convert -density 300 - -quality 100 %s && rm -f %s" // what video.sh runs on each frame
+#define CHUNKS_PER_THREAD 2 // row bands a frame is encoded in, per thread, where the format allows
 
-typedef enum Status {
-    BUSY,
-    IDLE
-} Status;
 
-
-typedef struct Result {
-    Pixel *buf;
+// a unit of work: rows of len pixels starting at startPx, one image width
+// apart (a linear strip is a single row that may wrap the image edge)
+typedef struct Tile {
+    int startPx;
     int len;
-} Result;
+    int rows;
+    long key;
+} Tile;
+
+
+// a node group's share of a frame's tiles, on a line of its own
+typedef struct GroupNext {
+    _Alignas(CACHE_LINE) atomic_int next;
+} GroupNext;
 
 
+// one frame in flight: its own renderer plus the image its tiles are
+// rendered into, allocated once and reused for every frame through the slot;
+// the image and encoded bands start on cache lines so that neighbouring
+// strips and bands only share a line where they meet
+typedef struct Frame {
+    Renderer *rptr;
+    char fileName[256];
+    int step;
+    Pixel *pixels;
+    double posted;
+
+    // the encoded frame, made by the workers in row bands once the image is done
+    char *text;
+    struct iovec *chunks;
+    long *chunkPrims;
+
+    // tile dispensers, one per node group, hot on every task so kept apart
+    // from the rest; a group's tiles are a contiguous run of the tile order,
+    // so its workers are the first to touch, and place, that part of the image
+    GroupNext next[TOPO_NODES];
+    _Alignas(CACHE_LINE) atomic_int left;
+
+    // band dispenser, closed until the last tile is in
+    _Alignas(CACHE_LINE) atomic_int encNext;
+    _Alignas(CACHE_LINE) atomic_int encLeft;
+} Frame;
+
+
+// each worker sits on its own cache line so that bookkeeping from one
+// thread doesn't invalidate the line another thread is reading
 typedef struct Worker {
-    pthread_t tid;
-    Status stat;
-    int startPx;
-    Result *result;
+    _Alignas(CACHE_LINE) pthread_t tid;
+    unsigned long frame;
+    double blocked; // asleep waiting for frames to be posted
+    double alive;
+    double busy; // inside tasks
+    double maxTask;
+    long tasks;
+    RenderStats stats;
+    Placement place;
 } Worker;
 
 
 typedef struct TPool {
-    FILE *fptr;
-    Renderer *rptr;
     Worker *workers;
+    Frame *frames;
+    Tile *tiles;
+    pthread_t writer;
+    ImgWriter save;
+    const ImgEncoder *enc;
+    ImgOpts opts;
+    Jobs *jobs; // conversions of written frames, if any
+    Manifest *manifest; // where written frames are noted, if anywhere
+    long pixels;
     int size;
-    int capacity;
+    int depth;
+    int numTasks;
+    int numGroups;
+    int groupStart[TOPO_NODES + 1]; // group g renders tiles groupStart[g] up to groupStart[g + 1]
+    Topology topo;
+    char bind[8];
+    int numChunks; // 0 unless the frames are encoded on the workers
+    int chunkRows;
+    long chunkCap;
     bool die;
-    int taskSize;
-    int written;
+    bool json;
+    unsigned long posted;
+    unsigned long written;
+    double writerBlocked;
+    double submitBlocked;
+    double started;
+    double *latency;
+    long capLatency;
 
     pthread_mutex_t mutex;
     pthread_cond_t start;
+    pthread_cond_t ready;
+    pthread_cond_t space;
 } TPool;
 
 
@@ -48,20 +122,184 @@ typedef struct WorkerArgs {
 } WorkerArgs;
 
 
-static Result *gen_pixels(TPool *pool, int widx) {
-    int numPxsLeft = pool->rptr->width * pool->rptr->height - pool->workers[widx].startPx;
-    int numPxs = numPxsLeft < pool->taskSize ? numPxsLeft : pool->taskSize;
+static void *line_alloc(size_t size) {
+    // aligned_alloc wants a whole number of lines
+    return aligned_alloc(CACHE_LINE, (size + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE);
+}
+
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+static void gen_pixels(TPool *pool, Frame *frame, int task, RenderStats *stats) {
+    // render straight into the slot's image, no allocation per task
+    Tile *tile = pool->tiles + task;
+    int stride = frame->rptr->width;
+    if (frame->rptr->refine >= 0) {
+        render_refine(frame->rptr, tile->startPx % stride, tile->startPx / stride, tile->len, tile->rows, frame->pixels + tile->startPx, stats);
+        return;
+    }
+    for (int row = 0; row < tile->rows; ++row) {
+        int startPx = tile->startPx + row * stride;
+        render_span(frame->rptr, startPx, tile->len, frame->pixels + startPx, stats);
+    }
+}
+
+
+// position of (x, y) along a z-order curve
+static long morton_key(int x, int y) {
+    long key = 0;
+    for (int bit = 0; bit < 16; ++bit) {
+        key |= (long) ((x >> bit) & 1) << (2 * bit);
+        key |= (long) ((y >> bit) & 1) << (2 * bit + 1);
+    }
+    return key;
+}
 
-    Result *out = malloc(sizeof(Result));
-    out->buf = malloc(numPxs * sizeof(Pixel *));
-    out->len = numPxs;
 
-    for (int i = 0; i < numPxs; ++i) {
-        int pxNum = pool->workers[widx].startPx + i;
-        out->buf[i] = render(pool->rptr, pxNum);
+// position of (x, y) along a hilbert curve filling an n x n grid, n a power of 2
+static long hilbert_key(int n, int x, int y) {
+    long key = 0;
+    for (int s = n / 2; s > 0; s /= 2) {
+        int rx = (x & s) > 0;
+        int ry = (y & s) > 0;
+        key += (long) s * s * ((3 * rx) ^ ry);
+        if (!ry) {
+            if (rx) {
+                x = s - 1 - x;
+                y = s - 1 - y;
+            }
+            int t = x;
+            x = y;
+            y = t;
+        }
     }
+    return key;
+}
 
-    return out;
+
+static int tile_cmp(const void *a, const void *b) {
+    long ka = ((const Tile *) a)->key;
+    long kb = ((const Tile *) b)->key;
+    return (ka > kb) - (ka < kb);
+}
+
+
+// lay the image out as strips of taskSize pixels, or as WxH tiles visited
+// in row, morton or hilbert order; returns the number of tasks
+static int make_tiles(TPool *pool, KerrArgs *args) {
+    int numPxs = args->width * args->height;
+    int tileWidth = args->tileWidth, tileHeight = args->tileHeight;
+    if (!tileWidth && args->refine >= 0) {
+        // refining needs 2D tiles to find neighbours in
+        tileWidth = tileHeight = REFINE_TILE;
+    }
+    if (!tileWidth) {
+        int numTasks = (numPxs + args->taskSize - 1) / args->taskSize;
+        pool->tiles = malloc(numTasks * sizeof(Tile));
+        for (int t = 0; t < numTasks; ++t) {
+            int startPx = t * args->taskSize;
+            int numPxsLeft = numPxs - startPx;
+            pool->tiles[t] = (Tile) {startPx, numPxsLeft < args->taskSize ? numPxsLeft : args->taskSize, 1, t};
+        }
+        return numTasks;
+    }
+
+    int cols = (args->width + tileWidth - 1) / tileWidth;
+    int rows = (args->height + tileHeight - 1) / tileHeight;
+    int side = 1;
+    while (side < cols || side < rows) side *= 2;
+    pool->tiles = malloc(cols * rows * sizeof(Tile));
+    for (int ty = 0; ty < rows; ++ty) {
+        for (int tx = 0; tx < cols; ++tx) {
+            int x0 = tx * tileWidth;
+            int y0 = ty * tileHeight;
+            Tile *tile = pool->tiles + ty * cols + tx;
+            tile->startPx = y0 * args->width + x0;
+            tile->len = args->width - x0 < tileWidth ? args->width - x0 : tileWidth;
+            tile->rows = args->height - y0 < tileHeight ? args->height - y0 : tileHeight;
+            if (!strcmp(args->tileOrder, "morton")) tile->key = morton_key(tx, ty);
+            else if (!strcmp(args->tileOrder, "hilbert")) tile->key = hilbert_key(side, tx, ty);
+            else tile->key = ty * cols + tx;
+        }
+    }
+    qsort(pool->tiles, cols * rows, sizeof(Tile), tile_cmp);
+    return cols * rows;
+}
+
+
+// encodes one row band of a rendered frame into its slot of the frame's buffer
+static void encode_chunk(TPool *pool, Frame *frame, int chunk) {
+    int width = frame->rptr->width, height = frame->rptr->height;
+    int y0 = chunk * pool->chunkRows;
+    int y1 = y0 + pool->chunkRows < height ? y0 + pool->chunkRows : height;
+    char *dest = frame->text + chunk * pool->chunkCap;
+    frame->chunkPrims[chunk] = 0;
+    frame->chunks[chunk].iov_base = dest;
+    frame->chunks[chunk].iov_len = pool->enc->encode(dest, frame->pixels, width, height, y0, y1, &(pool->opts), frame->chunkPrims + chunk);
+
+    // whoever encodes the last band hands the frame to the writer
+    if (atomic_fetch_sub(&(frame->encLeft), 1) == 1) {
+        pthread_mutex_lock(&(pool->mutex));
+        pthread_cond_signal(&(pool->ready));
+        pthread_mutex_unlock(&(pool->mutex));
+    }
+}
+
+
+// pulls bands from one frame until none are left to start
+static void encode_frame(TPool *pool, Frame *frame) {
+    int chunk;
+    while (atomic_load(&(frame->encNext)) < pool->numChunks && (chunk = atomic_fetch_add(&(frame->encNext), 1)) < pool->numChunks) {
+        encode_chunk(pool, frame, chunk);
+    }
+}
+
+
+static bool encode_open(TPool *pool) {
+    if (!pool->numChunks) return false;
+    for (int i = 0; i < pool->depth; ++i) {
+        if (atomic_load(&(pool->frames[i].encNext)) < pool->numChunks) return true;
+    }
+    return false;
+}
+
+
+// encoding finished frames comes before rendering new ones, since
+// the writer is waiting on it
+static void encode_all(TPool *pool, Worker *me) {
+    if (!encode_open(pool)) return;
+    double t0 = now();
+    for (int i = 0; i < pool->depth; ++i) encode_frame(pool, pool->frames + i);
+    me->busy += now() - t0;
+}
+
+
+// renders one tile of the frame, the last one in handing the frame on
+static void render_task(TPool *pool, Worker *me, Frame *frame, int task) {
+    encode_all(pool, me);
+    double t0 = now();
+    gen_pixels(pool, frame, task, &(me->stats));
+    double took = now() - t0;
+    me->busy += took;
+    me->tasks += 1;
+    if (took > me->maxTask) me->maxTask = took;
+
+    // whoever finishes the last tile hands the frame to the writer,
+    // or opens its bands to every thread if there's encoding to do
+    if (atomic_fetch_sub(&(frame->left), 1) == 1) {
+        pthread_mutex_lock(&(pool->mutex));
+        if (pool->numChunks) {
+            atomic_store(&(frame->encNext), 0);
+            pthread_cond_broadcast(&(pool->start));
+        }
+        pthread_cond_signal(&(pool->ready));
+        pthread_mutex_unlock(&(pool->mutex));
+    }
 }
 
 
@@ -69,147 +307,455 @@ static void *worker(void *args) {
     WorkerArgs *wargs = (WorkerArgs *) args;
     TPool *pool = wargs->pool;
     Worker *me = pool->workers + wargs->widx;
-    // printf("thread created with widx %d!\n", wargs->widx);
-
-    struct timespec maxwait;
-    maxwait.tv_nsec = 250000000;
-    maxwait.tv_sec = 0;
+    double born = now();
 
-    while (!pool->die) {
-        while (me->stat == IDLE && !pool->die) {
-            // wait for signal to start work
-            pthread_mutex_lock(&(pool->mutex));
-            // printf("locked mutex, waiting for signal!\n");
-            pthread_cond_timedwait(&(pool->start), &(pool->mutex), &maxwait);
+    pthread_mutex_lock(&(pool->mutex));
+    while (true) {
+        // sleep until the next frame is posted, a finished one needs
+        // encoding or the pool shuts down
+        if (me->frame == pool->posted && !pool->die && !encode_open(pool)) {
+            double t0 = now();
+            while (me->frame == pool->posted && !pool->die && !encode_open(pool)) {
+                pthread_cond_wait(&(pool->start), &(pool->mutex));
+            }
+            if (me->frame < pool->posted || encode_open(pool)) me->blocked += now() - t0;
+        }
+        if (me->frame == pool->posted) {
+            // nothing to render, but the writer may still be owed bands
+            if (!encode_open(pool)) break;
             pthread_mutex_unlock(&(pool->mutex));
+            encode_all(pool, me);
+            pthread_mutex_lock(&(pool->mutex));
+            continue;
         }
-        if (me->startPx < 0) continue;
+        Frame *frame = pool->frames + me->frame % pool->depth;
+        pthread_mutex_unlock(&(pool->mutex));
+
+        // pull tiles from the worker's own group until they run dry, then
+        // help the other groups, then move straight on
+        for (int k = 0; k < pool->numGroups; ++k) {
+            int g = (me->place.group + k) % pool->numGroups;
+            int task;
+            while ((task = atomic_fetch_add(&(frame->next[g].next), 1)) < pool->groupStart[g + 1]) {
+                render_task(pool, me, frame, task);
+            }
+        }
+        encode_all(pool, me);
 
-        // actually do the work
-        // printf("aight actually doing work now at pixel %d\n", me->startPx);
-        me->result = gen_pixels(pool, wargs->widx);
-        me->stat = IDLE;
+        pthread_mutex_lock(&(pool->mutex));
+        me->frame += 1;
     }
+    pthread_mutex_unlock(&(pool->mutex));
+    me->alive = now() - born;
 
-    // printf("uh oh dying now\n");
     free(wargs);
     return NULL;
 }
 
 
-static void tpool_flush(TPool *pool) {
-    // signal all workers to start
-    pthread_mutex_lock(&(pool->mutex));
-    // printf("locked mutex, broadcasting\n");
-    pthread_cond_broadcast(&(pool->start));
-    pthread_mutex_unlock(&(pool->mutex));
-
-    // wait for workers to finish
-    // printf("waiting for workers to be done\n");
-    bool done = false;
-    while (!done) {
-        done = true;
-        usleep(250000);
-        for (int i = 0; i < pool->size; ++i) {
-            if (pool->workers[i].stat == BUSY) {
-                done = false;
-                break;
-            }
-        }
+static long write_frame(TPool *pool, Frame *frame) {
+    // tiles render in place, so the slot's image is ready as is
+    pool->pixels += frame->rptr->width * frame->rptr->height;
+    long written;
+    if (pool->numChunks) {
+        // encode whatever bands the workers haven't started, wait out the
+        // rest, then the frame goes out in one go
+        encode_frame(pool, frame);
+        pthread_mutex_lock(&(pool->mutex));
+        while (atomic_load(&(frame->encLeft))) pthread_cond_wait(&(pool->ready), &(pool->mutex));
+        pthread_mutex_unlock(&(pool->mutex));
+        for (int i = 0; i < pool->numChunks; ++i) pool->opts.prims += frame->chunkPrims[i];
+        written = pool->enc->flush(frame->fileName, frame->chunks, pool->numChunks, frame->rptr->width, frame->rptr->height, &(pool->opts));
+    } else {
+        written = pool->save(frame->fileName, frame->pixels, frame->rptr->width, frame->rptr->height, &(pool->opts));
     }
+    if (!written) fprintf(stderr, "Error: failed to write \"%s\"\n", frame->fileName);
+    return written;
+}
 
-    // write work to tga file
-    // printf("workers are done, writing to file...\n");
-    for (int i = 0; i < pool->size; ++i) {
-        if (pool->workers[i].result) {
-            // printf("writing %d pixels at %d\n", pool->workers[i].result->len, pool->workers[i].startPx);
-            int startPx = (pool->rptr->width * pool->rptr->height) - (1 + pool->written);
-            jgr_write(
-                pool->fptr,
-                pool->workers[i].result->buf, 
-                pool->workers[i].result->len, 
-                startPx, 
-                pool->rptr->width
-            );
-            pool->written += pool->workers[i].result->len;
-            free(pool->workers[i].result->buf);
-            free(pool->workers[i].result);
-            pool->workers[i].result = NULL;
-            pool->workers[i].startPx = -1;
+
+// hands a written jgraph frame to the job runner, which turns it into a
+// png beside it and removes the jgr once that worked
+static void convert_frame(TPool *pool, Frame *frame) {
+    char png[256];
+    char cmd[1024];
+    snprintf(png, sizeof(png), "%s", frame->fileName);
+    char *ext = strrchr(png, '.');
+    if (ext) *ext = '\0';
+    strncat(png, ".png", sizeof(png) - strlen(png) - 1);
+    snprintf(cmd, sizeof(cmd), CONVERT_CMD, frame->fileName, png, frame->fileName);
+    jobs_run(pool->jobs, cmd, frame->fileName);
+}
+
+
+static void *writer(void *args) {
+    TPool *pool = (TPool *) args;
+
+    pthread_mutex_lock(&(pool->mutex));
+    while (true) {
+        // wait for the oldest frame in flight to finish rendering
+        double t0 = now();
+        while (!pool->die || pool->written < pool->posted) {
+            if (pool->written < pool->posted && !atomic_load(&(pool->frames[pool->written % pool->depth].left))) break;
+            pthread_cond_wait(&(pool->ready), &(pool->mutex));
         }
+        if (pool->written == pool->posted) break;
+        pool->writerBlocked += now() - t0;
+        Frame *frame = pool->frames + pool->written % pool->depth;
+        pthread_mutex_unlock(&(pool->mutex));
+
+        // a full job runner holds the writer up, and through the frame
+        // slots the renderers, rather than piling up conversions
+        if (write_frame(pool, frame)) {
+            if (pool->manifest) manifest_record(pool->manifest, frame->step, frame->fileName);
+            if (pool->jobs) convert_frame(pool, frame);
+        }
+
+        // release the slot back to the submitter
+        pthread_mutex_lock(&(pool->mutex));
+        if (pool->written < (unsigned long) pool->capLatency) pool->latency[pool->written] = now() - frame->posted;
+        pool->written += 1;
+        pthread_cond_signal(&(pool->space));
     }
+    pthread_mutex_unlock(&(pool->mutex));
 
-    // printf("flush was a success!\n");
-    pool->capacity = 0;
+    return NULL;
 }
 
 
 TPool *tpool_init(KerrArgs *args) {
     TPool *pool = malloc(sizeof(TPool));
-    pool->die = 0;
-    pool->fptr = jgr_open(args->fileName);
-    pool->rptr = render_init(args);
-    pool->taskSize = args->taskSize;
+    pool->die = false;
+    pool->json = !strcmp(args->report, "json");
     pool->size = args->numThreads;
-    pool->capacity = 0;
-    pool->workers = malloc(args->numThreads * sizeof(Worker));
+    pool->numTasks = make_tiles(pool, args);
+
+    // workers are grouped by the numa node they're bound to, each group
+    // owning a run of tiles in proportion to its workers
+    pool->workers = aligned_alloc(CACHE_LINE, pool->size * sizeof(Worker));
+    Placement *place = malloc(pool->size * sizeof(Placement));
+    snprintf(pool->bind, sizeof(pool->bind), "%s", args->bind ? args->bind : "none");
+    topo_detect(&(pool->topo), "", NULL, 0);
+    pool->numGroups = topo_place(&(pool->topo), pool->size, pool->bind, place);
+    int count[TOPO_NODES] = {0};
+    for (int i = 0; i < pool->size; ++i) {
+        pool->workers[i].place = place[i];
+        count[place[i].group] += 1;
+    }
+    free(place);
+    int before = 0;
+    for (int g = 0; g < pool->numGroups; ++g) {
+        pool->groupStart[g] = (long) pool->numTasks * before / pool->size;
+        before += count[g];
+    }
+    pool->groupStart[pool->numGroups] = pool->numTasks;
+
+    // without an explicit depth, keep enough frames in flight that every
+    // thread has (frame, tile) pairs to pull, with one more for the writer
+    pool->depth = args->queueDepth;
+    if (!pool->depth) {
+        pool->depth = (2 * pool->size + pool->numTasks - 1) / pool->numTasks + 1;
+        if (pool->depth > args->num_steps + 1) pool->depth = args->num_steps + 1;
+        if (pool->depth > MAX_DEPTH) pool->depth = MAX_DEPTH;
+        if (pool->depth < 2) pool->depth = 2;
+    }
+    pool->posted = 0;
     pool->written = 0;
+    pool->writerBlocked = 0.0;
+    pool->submitBlocked = 0.0;
+    pool->save = img_writer(args->format);
+    pool->opts = (ImgOpts) {args->merge, args->delay, args->loop, 0, 0};
+
+    // formats that can be encoded in memory are, on the workers, in row
+    // bands spread over them if the format allows it
+    pool->enc = img_encoder(args->format, &(pool->opts));
+    pool->numChunks = 0;
+    if (pool->enc) {
+        pool->numChunks = pool->enc->bands ? CHUNKS_PER_THREAD * pool->size : 1;
+        if (pool->numChunks > args->height) pool->numChunks = args->height;
+        pool->chunkRows = (args->height + pool->numChunks - 1) / pool->numChunks;
+        pool->numChunks = (args->height + pool->chunkRows - 1) / pool->chunkRows;
+        pool->chunkCap = pool->enc->bound(args->width, args->height, pool->chunkRows);
+        pool->chunkCap = (pool->chunkCap + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    }
+    pool->jobs = args->convertJobs ? jobs_init(args->convertJobs) : NULL;
+    pool->manifest = NULL;
+    pool->pixels = 0;
+    pool->started = now();
+    pool->capLatency = args->num_steps;
+    pool->latency = malloc(pool->capLatency * sizeof(double));
 
     pthread_mutex_init(&(pool->mutex), NULL);
     pthread_cond_init(&(pool->start), NULL);
+    pthread_cond_init(&(pool->ready), NULL);
+    pthread_cond_init(&(pool->space), NULL);
+
+    // frame slots make up the bounded queue between renderers and writer
+    pool->frames = aligned_alloc(CACHE_LINE, pool->depth * sizeof(Frame));
+    for (int i = 0; i < pool->depth; ++i) {
+        pool->frames[i].rptr = render_init(args);
+        pool->frames[i].pixels = line_alloc(args->width * args->height * sizeof(Pixel));
+        pool->frames[i].text = pool->numChunks ? line_alloc(pool->numChunks * pool->chunkCap) : NULL;
+        pool->frames[i].chunks = pool->numChunks ? malloc(pool->numChunks * sizeof(struct iovec)) : NULL;
+        pool->frames[i].chunkPrims = pool->numChunks ? malloc(pool->numChunks * sizeof(long)) : NULL;
+        for (int g = 0; g < pool->numGroups; ++g) atomic_init(&(pool->frames[i].next[g].next), pool->groupStart[g + 1]);
+        atomic_init(&(pool->frames[i].left), 0);
+        atomic_init(&(pool->frames[i].encNext), pool->numChunks);
+        atomic_init(&(pool->frames[i].encLeft), 0);
+    }
 
-    // create threads
+    // create threads, pinned where asked to
     for (int i = 0; i < pool->size; ++i) {
-        pool->workers[i].result = NULL;
-        pool->workers[i].startPx = -1;
-        pool->workers[i].stat = IDLE;
+        pool->workers[i].frame = 0;
+        pool->workers[i].blocked = 0.0;
+        pool->workers[i].alive = 0.0;
+        pool->workers[i].busy = 0.0;
+        pool->workers[i].maxTask = 0.0;
+        pool->workers[i].tasks = 0;
+        pool->workers[i].stats = (RenderStats) {0};
         WorkerArgs *wargs = malloc(sizeof(WorkerArgs));
         wargs->pool = pool;
         wargs->widx = i;
-        pthread_create(&(pool->workers[i].tid), NULL, worker, (void *) wargs);
+        Worker *w = pool->workers + i;
+        if (!topo_spawn(&(pool->topo), &(w->place), &(w->tid), worker, (void *) wargs)) {
+            fprintf(stderr, "Warning: could not pin thread %d, running it unpinned\n", i);
+        }
     }
+    pthread_create(&(pool->writer), NULL, writer, (void *) pool);
 
     return pool;
 }
 
 
-void tpool_push(TPool *pool, int todo) {
-    // add task to array
-    // printf("adding task for pixel %d\n", todo);
-    pool->workers[pool->capacity].startPx = todo;
-    pool->workers[pool->capacity].stat = BUSY;
-    pool->capacity += 1;
+void tpool_manifest(TPool *pool, Manifest *manifest) {
+    // a resumed animation goes on from the frames already in its file
+    pool->manifest = manifest;
+    pool->opts.frames = manifest_count(manifest);
+}
+
+
+void tpool_submit(TPool *pool, KerrArgs *args, const char *fileName) {
+    // wait for a free slot, i.e. for the writer to catch up
+    pthread_mutex_lock(&(pool->mutex));
+    if (pool->posted - pool->written == (unsigned long) pool->depth) {
+        double t0 = now();
+        while (pool->posted - pool->written == (unsigned long) pool->depth) {
+            pthread_cond_wait(&(pool->space), &(pool->mutex));
+        }
+        pool->submitBlocked += now() - t0;
+    }
+    Frame *frame = pool->frames + pool->posted % pool->depth;
+    pthread_mutex_unlock(&(pool->mutex));
 
-    // check if filled thread pool
-    if (pool->capacity == pool->size) {
-        // printf("uh oh filled pool\n");
-        tpool_flush(pool);
+    // move the slot's camera, opening the dispenser last
+    frame->posted = now();
+    render_update(frame->rptr, args);
+    snprintf(frame->fileName, sizeof(frame->fileName), "%s", fileName);
+    frame->step = args->step;
+    atomic_store(&(frame->encNext), pool->numChunks);
+    atomic_store(&(frame->encLeft), pool->numChunks);
+    atomic_store(&(frame->left), pool->numTasks);
+    for (int g = 0; g < pool->numGroups; ++g) atomic_store(&(frame->next[g].next), pool->groupStart[g]);
+
+    // post the frame and wake every worker
+    pthread_mutex_lock(&(pool->mutex));
+    pool->posted += 1;
+    pthread_cond_broadcast(&(pool->start));
+    pthread_mutex_unlock(&(pool->mutex));
+}
+
+
+static void print_stats(TPool *pool, PoolStats *stats) {
+    printf(
+        "Average Steps per Ray: %.1f\n",
+        stats->rays ? stats->steps / (double) stats->rays : 0.0
+    );
+    long ended = stats->fates[ESCAPED] + stats->fates[HORIZON] + stats->fates[DISK];
+    if (ended) {
+        printf(
+            "Ray Fates: %.1f%% escaped, %.1f%% horizon, %.1f%% disk\n",
+            100.0 * stats->fates[ESCAPED] / ended, 100.0 * stats->fates[HORIZON] / ended, 100.0 * stats->fates[DISK] / ended
+        );
+    }
+    if (stats->tableSteps) printf("Table Steps per Frame: %.1f\n", stats->tableSteps / (double) stats->frames);
+    printf("Frames in Flight: %d (%d tasks per frame)\n", stats->depth, stats->numTasks);
+    char quota[32] = "no quota";
+    if (stats->quota > 0.0) snprintf(quota, sizeof(quota), "quota %.2f cpus", stats->quota);
+    printf(
+        "Placement: %d threads on %d usable cpus (%s), %d node groups, pinned to %s\n",
+        stats->numThreads, stats->usableCpus, quota, stats->numGroups, stats->bind
+    );
+    printf(
+        "Parallel Efficiency: %.1f%% of thread time busy\n",
+        stats->seconds > 0.0 ? 100.0 * stats->busy / (stats->numThreads * stats->seconds) : 0.0
+    );
+    printf(
+        "Task Time: %.3fms mean, %.3fms max\n",
+        stats->tasks ? 1e3 * stats->busy / stats->tasks : 0.0, 1e3 * stats->maxTask
+    );
+    printf(
+        "Writer Blocked: %.3fs\n"
+        "Renderers Blocked: %.3fs (%.3fs per thread)\n"
+        "Renderers Idle: %.3fs (%.3fs per thread)\n"
+        "Submit Blocked: %.3fs\n",
+        stats->writerBlocked,
+        stats->renderBlocked, stats->renderBlocked / stats->numThreads,
+        stats->idle, stats->idle / stats->numThreads,
+        stats->submitBlocked
+    );
+    for (int i = 0; i < pool->size; ++i) {
+        Worker *w = pool->workers + i;
+        printf(
+            "Thread %d: %ld tasks, %.3fs busy, %.3fs idle, %ld rays, %ld steps",
+            i, w->tasks, w->busy, w->alive - w->busy, w->stats.rays, w->stats.steps
+        );
+        if (w->place.cpu >= 0) printf(", cpu %d", w->place.cpu);
+        if (w->place.node >= 0) printf(", node %d", w->place.node);
+        printf("\n");
+    }
+    if (stats->refined) {
+        printf(
+            "Rays Traced: %ld for %ld pixels (%.1f%%)\n",
+            stats->rays, stats->pixels, stats->pixels ? 100.0 * stats->rays / stats->pixels : 0.0
+        );
+    }
+    if (stats->prims) {
+        printf(
+            "JGR Primitives: %ld for %ld pixels (%.2fx fewer)\n",
+            stats->prims, stats->pixels, stats->pixels / (double) stats->prims
+        );
+    }
+    if (stats->conversions) {
+        printf(
+            "Conversions: %ld run, %ld failed, writer waited %.3fs for a free job\n",
+            stats->conversions, stats->convertFailed, stats->convertBlocked
+        );
     }
 }
 
 
-void tpool_close(TPool *pool) {
-    // check if there is still work to be done
-    if (pool->capacity) {
-        tpool_flush(pool);
+static void print_json(TPool *pool, PoolStats *stats) {
+    printf("{\n");
+    printf(
+        "  \"frames\": %ld, \"pixels\": %ld, \"rays\": %ld, \"steps\": %ld, \"table_steps\": %ld, \"seconds\": %.4f,\n",
+        stats->frames, stats->pixels, stats->rays, stats->steps, stats->tableSteps, stats->seconds
+    );
+    printf(
+        "  \"fates\": {\"escaped\": %ld, \"horizon\": %ld, \"disk\": %ld},\n",
+        stats->fates[ESCAPED], stats->fates[HORIZON], stats->fates[DISK]
+    );
+    printf(
+        "  \"depth\": %d, \"tasks_per_frame\": %d, \"tasks\": %ld, \"task_ms\": {\"mean\": %.4f, \"max\": %.4f},\n",
+        stats->depth, stats->numTasks, stats->tasks, stats->tasks ? 1e3 * stats->busy / stats->tasks : 0.0, 1e3 * stats->maxTask
+    );
+    printf(
+        "  \"seconds_blocked\": {\"writer\": %.4f, \"renderers\": %.4f, \"submit\": %.4f}, \"seconds_idle\": %.4f,\n",
+        stats->writerBlocked, stats->renderBlocked, stats->submitBlocked, stats->idle
+    );
+    printf(
+        "  \"placement\": {\"usable_cpus\": %d, \"quota\": %.2f, \"groups\": %d, \"pinning\": \"%s\"}, \"efficiency\": %.4f,\n",
+        stats->usableCpus, stats->quota, stats->numGroups, stats->bind,
+        stats->seconds > 0.0 ? stats->busy / (stats->numThreads * stats->seconds) : 0.0
+    );
+    if (stats->prims) printf("  \"jgr_primitives\": %ld,\n", stats->prims);
+    if (stats->conversions) {
+        printf(
+            "  \"conversions\": {\"run\": %ld, \"failed\": %ld, \"seconds_blocked\": %.4f},\n",
+            stats->conversions, stats->convertFailed, stats->convertBlocked
+        );
+    }
+    printf("  \"threads\": [\n");
+    for (int i = 0; i < pool->size; ++i) {
+        Worker *w = pool->workers + i;
+        printf(
+            "    {\"tasks\": %ld, \"busy\": %.4f, \"idle\": %.4f, \"blocked\": %.4f, \"max_task_ms\": %.4f, \"rays\": %ld, \"steps\": %ld, "
+            "\"fates\": {\"escaped\": %ld, \"horizon\": %ld, \"disk\": %ld}, \"group\": %d, \"node\": %d, \"cpu\": %d}%s\n",
+            w->tasks, w->busy, w->alive - w->busy, w->blocked, 1e3 * w->maxTask, w->stats.rays, w->stats.steps,
+            w->stats.fates[ESCAPED], w->stats.fates[HORIZON], w->stats.fates[DISK],
+            w->place.group, w->place.node, w->place.cpu,
+            i == pool->size - 1 ? "" : ","
+        );
     }
+    printf("  ]\n}\n");
+}
 
-    // signal all threads to die
-    pool->die = true;
+
+// finishes the queued frames and tears the pool down; the stats go to the
+// caller when it asks for them, and are printed otherwise
+void tpool_close(TPool *pool, PoolStats *stats) {
+    // signal all threads to die once the queued frames are written
     pthread_mutex_lock(&(pool->mutex));
+    pool->die = true;
     pthread_cond_broadcast(&(pool->start));
+    pthread_cond_signal(&(pool->ready));
     pthread_mutex_unlock(&(pool->mutex));
 
     // join each thread
     for (int i = 0; i < pool->size; ++i) {
         pthread_join(pool->workers[i].tid, NULL);
     }
+    pthread_join(pool->writer, NULL);
+    long conversions = 0, convertFailed = 0;
+    double convertBlocked = 0.0;
+    if (pool->jobs) convertFailed = jobs_close(pool->jobs, &conversions, &convertBlocked);
+
+    // gather how much work was done and how long each stage sat waiting on the others
+    PoolStats out = {
+        .numThreads = pool->size,
+        .depth = pool->depth,
+        .numTasks = pool->numTasks,
+        .numGroups = pool->numGroups,
+        .usableCpus = pool->topo.numCpus,
+        .quota = pool->topo.quota,
+        .frames = pool->written,
+        .pixels = pool->pixels,
+        .prims = pool->opts.prims,
+        .refined = pool->frames[0].rptr->refine >= 0,
+        .seconds = now() - pool->started,
+        .writerBlocked = pool->writerBlocked,
+        .submitBlocked = pool->submitBlocked,
+        .conversions = conversions,
+        .convertFailed = convertFailed,
+        .convertBlocked = convertBlocked,
+        .latency = pool->latency,
+        .numLatency = pool->written < (unsigned long) pool->capLatency ? (long) pool->written : pool->capLatency
+    };
+    snprintf(out.bind, sizeof(out.bind), "%s", pool->bind);
+    for (int i = 0; i < pool->size; ++i) {
+        Worker *w = pool->workers + i;
+        out.renderBlocked += w->blocked;
+        out.busy += w->busy;
+        out.idle += w->alive - w->busy;
+        out.tasks += w->tasks;
+        if (w->maxTask > out.maxTask) out.maxTask = w->maxTask;
+        out.rays += w->stats.rays;
+        out.steps += w->stats.steps;
+        for (int f = 0; f < 3; ++f) out.fates[f] += w->stats.fates[f];
+    }
+    for (int i = 0; i < pool->depth; ++i) out.tableSteps += pool->frames[i].rptr->tableSteps;
+    if (stats) {
+        *stats = out;
+    } else {
+        if (pool->json) print_json(pool, &out);
+        else print_stats(pool, &out);
+        free(out.latency);
+    }
 
     // free a bunch of stuff
+    for (int i = 0; i < pool->depth; ++i) {
+        render_free(pool->frames[i].rptr);
+        free(pool->frames[i].pixels);
+        free(pool->frames[i].text);
+        free(pool->frames[i].chunks);
+        free(pool->frames[i].chunkPrims);
+    }
+    free(pool->frames);
+    free(pool->tiles);
     free(pool->workers);
+
     pthread_mutex_destroy(&(pool->mutex));
     pthread_cond_destroy(&(pool->start));
-    jgr_close(pool->fptr);
-    free(pool->rptr);
+    pthread_cond_destroy(&(pool->ready));
+    pthread_cond_destroy(&(pool->space));
     free(pool);
-}
\ No newline at end of file
+}
@@ -2,18 +2,54 @@
 #define TPOOL_H
 
 
+#include <stdio.h>
 #include <stdbool.h>
 #include "args.h"
+#include "manifest.h"
 
 
-typedef enum Status Status;
-typedef struct Task Task;
 typedef struct TPool TPool;
 
 
+// what a pool did over its lifetime, filled in by tpool_close
+typedef struct PoolStats {
+    int numThreads;
+    int depth;
+    int numTasks;
+    int numGroups; // workers grouped by numa node, 1 unless bound
+    int usableCpus;
+    double quota; // cgroup cpu limit, 0 for none
+    char bind[8];
+    long frames;
+    long pixels;
+    long rays;
+    long steps;
+    long tableSteps;
+    long fates[3]; // black hole rays that escaped, fell in or hit the disk
+    long tasks;
+    long prims;
+    bool refined;
+    double seconds;
+    double busy; // summed over threads, as are the blocked and idle times
+    double idle;
+    double maxTask;
+    double writerBlocked;
+    double renderBlocked;
+    double submitBlocked;
+    long conversions; // jgraph pipelines started, failed, and how long the writer waited to start them
+    long convertFailed;
+    double convertBlocked;
+    double *latency; // seconds from submit to written for the first numLatency frames, freed by the caller
+    long numLatency;
+} PoolStats;
+
+
 TPool *tpool_init(KerrArgs *args);
-void tpool_push(TPool *pool, int todo);
-void tpool_close(TPool *pool);
+// records every frame written from here on in the manifest, whose frames
+// done so far count as written; call it before submitting anything
+void tpool_manifest(TPool *pool, Manifest *manifest);
+void tpool_submit(TPool *pool, KerrArgs *args, const char *fileName);
+void tpool_close(TPool *pool, PoolStats *stats);
 
 
 #endif
\ No newline at end of file
@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "args.h"
+#include "render.h"
+#include "tpool.h"
+
+// linked with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=aligned_alloc
+// so every allocation made from project code goes through these counters
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t num, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void *__real_aligned_alloc(size_t alignment, size_t size);
+
+static long allocs = 0;
+
+void *__wrap_malloc(size_t size) {
+    __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t num, size_t size) {
+    __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+    return __real_calloc(num, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+    return __real_realloc(ptr, size);
+}
+
+void *__wrap_aligned_alloc(size_t alignment, size_t size) {
+    __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+    return __real_aligned_alloc(alignment, size);
+}
+
+
+// a whole frame through render_span or render_refine must not touch the heap at all
+static int span_allocs(KerrArgs *args, const char *label) {
+    Renderer *rptr = render_init(args);
+    int numPx = args->width * args->height;
+    Pixel *image = malloc(numPx * sizeof(Pixel));
+    RenderStats stats = {0};
+
+    long before = allocs;
+    if (args->refine >= 0) render_refine(rptr, 0, 0, args->width, args->height, image, &stats);
+    else render_span(rptr, 0, numPx, image, &stats);
+    long count = allocs - before;
+
+    printf("%s: render %-16s %ld allocations per frame\n", count ? "FAIL" : "PASS", label, count);
+    free(image);
+    render_free(rptr);
+    return count == 0;
+}
+
+
+// allocations made by the pool over a run of numFrames frames
+static long pool_allocs(KerrArgs *args, int numFrames) {
+    long before = allocs;
+    TPool *pool = tpool_init(args);
+    for (int i = 0; i < numFrames; ++i) {
+        sprintf(args->fileName, "/tmp/alloc_test_%d.%s", i % 2, args->format);
+        args->pos[2] = -8 + .1 * i;
+        tpool_submit(pool, args, args->fileName);
+    }
+    tpool_close(pool, NULL);
+    return allocs - before;
+}
+
+
+int main() {
+    char fileName[64];
+    KerrArgs args = {
+        .pos = {1.1, .1, -8},
+        .dir = {0, 0, 1},
+        .fov = 90,
+        .width = 64,
+        .height = 36,
+        .taskSize = 100,
+        .fileName = fileName,
+        .numThreads = 2,
+        .integrator = "euler",
+        .tol = 1e-5,
+        .tileOrder = "row",
+        .packetWidth = 0,
+        .refine = -1,
+        .queueDepth = 2,
+        .format = "ppm",
+        .report = "text",
+        .scene = "schwarz"
+    };
+
+    int ok = 1;
+    ok &= span_allocs(&args, "scalar euler");
+    args.integrator = "rk45";
+    ok &= span_allocs(&args, "scalar rk45");
+    args.tableSize = 256;
+    ok &= span_allocs(&args, "table");
+    args.tableSize = 0;
+    args.integrator = "euler";
+    args.packetWidth = -1;
+    ok &= span_allocs(&args, "packets");
+    args.refine = 16;
+    ok &= span_allocs(&args, "refined");
+    args.refine = -1;
+    args.scene = "sphere";
+    ok &= span_allocs(&args, "sphere");
+    args.scene = "schwarz";
+
+    // whatever the writer needs per frame, it must not grow with the run
+    long runs[3] = {pool_allocs(&args, 2), pool_allocs(&args, 4), pool_allocs(&args, 8)};
+    long perFrame = (runs[1] - runs[0]) / 2;
+    int constant = runs[2] - runs[1] == 4 * perFrame && runs[1] - runs[0] == 2 * perFrame;
+    printf(
+        "%s: tpool %ld / %ld / %ld allocations over 2 / 4 / 8 frames, %ld per frame\n",
+        constant ? "PASS" : "FAIL", runs[0], runs[1], runs[2], perFrame
+    );
+    ok &= constant;
+
+    remove("/tmp/alloc_test_0.ppm");
+    remove("/tmp/alloc_test_1.ppm");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,41 @@
+#include <stdlib.h>
+#include "check.h"
+
+
+KerrArgs check_args(char *scene, char *integrator) {
+    return (KerrArgs) {
+        .dir = {0, 0, 1},
+        .fov = 90,
+        .width = 96,
+        .height = 54,
+        .integrator = integrator,
+        .tol = 1e-5,
+        .packetWidth = -1,
+        .refine = -1,
+        .escape = 6,
+        .scene = scene
+    };
+}
+
+
+Pixel *check_render(KerrArgs *args, Renderer *rptr, RenderStats *stats) {
+    Renderer *own = rptr ? NULL : render_init(args);
+    int numPx = args->width * args->height;
+    Pixel *out = malloc(numPx * sizeof(Pixel));
+    render_span(rptr ? rptr : own, 0, numPx, out, stats);
+    if (own) render_free(own);
+    return out;
+}
+
+
+PixelDiff check_diff(const Pixel *a, const Pixel *b, int numPx, int tolerance) {
+    PixelDiff diff = {0, 0};
+    for (int i = 0; i < numPx; ++i) {
+        int d = abs(a[i].r - b[i].r);
+        if (abs(a[i].g - b[i].g) > d) d = abs(a[i].g - b[i].g);
+        if (abs(a[i].b - b[i].b) > d) d = abs(a[i].b - b[i].b);
+        if (d > diff.worst) diff.worst = d;
+        diff.outliers += d > tolerance;
+    }
+    return diff;
+}
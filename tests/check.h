@@ -0,0 +1,24 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+
+#include "args.h"
+#include "render.h"
+
+
+// how far one picture is from another of the same size
+typedef struct PixelDiff {
+    int outliers; // pixels with any channel more than the tolerance off
+    int worst; // largest difference in any channel
+} PixelDiff;
+
+
+// the 96x54 camera looking down z that the render tests share, at no
+// position yet, with the renderer's default escape radius and no refining
+KerrArgs check_args(char *scene, char *integrator);
+// renders the whole frame with rptr, or with a renderer for args if it's NULL
+Pixel *check_render(KerrArgs *args, Renderer *rptr, RenderStats *stats);
+PixelDiff check_diff(const Pixel *a, const Pixel *b, int numPx, int tolerance);
+
+
+#endif
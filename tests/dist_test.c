@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "args.h"
+#include "dist.h"
+#include "tpool.h"
+
+#define FRAMES 3
+#define WORKERS 2
+#define SOCKET "/tmp/dist_test.sock"
+
+
+static int same_files(const char *a, const char *b) {
+    char cmd[256];
+    snprintf(cmd, sizeof(cmd), "cmp -s %s %s", a, b);
+    return !system(cmd);
+}
+
+
+// a worker that takes its first tile and dies with it; exits 0 if it got one
+static void fake_worker() {
+    for (int i = 0; i < 50; ++i) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        struct sockaddr_un sa = {.sun_family = AF_UNIX, .sun_path = SOCKET};
+        if (connect(fd, (struct sockaddr *) &sa, sizeof(sa))) {
+            close(fd);
+            usleep(20000);
+            continue;
+        }
+        DistHello hello;
+        DistTask task;
+        char argv[4096];
+        int ok = recv(fd, &hello, sizeof(hello), MSG_WAITALL) == sizeof(hello) && hello.len <= (int) sizeof(argv);
+        ok = ok && recv(fd, argv, hello.len, MSG_WAITALL) == hello.len;
+        ok = ok && recv(fd, &task, sizeof(task), MSG_WAITALL) == sizeof(task) && task.frame >= 0;
+        _exit(ok ? 0 : 1);
+    }
+    _exit(1);
+}
+
+
+// workers start once the fake one has had its turn
+static pid_t start_worker(KerrArgs *args, const char *addr, int delay) {
+    pid_t pid = fork();
+    if (pid) return pid;
+    usleep(delay);
+    _exit(dist_work(args, addr));
+}
+
+
+static int run(int argc, char **argv, const char *addr, bool withFake) {
+    KerrArgs *args = parse_args(argc, argv);
+    char fileName[64], refName[64];
+
+    // what the pool renders on its own
+    TPool *pool = tpool_init(args);
+    for (int f = 0; f < FRAMES; ++f) {
+        args->pos[2] = -8 + f;
+        snprintf(refName, sizeof(refName), "/tmp/dist_test_ref_%d.tga", f);
+        tpool_submit(pool, args, refName);
+    }
+    PoolStats poolStats;
+    tpool_close(pool, &poolStats);
+    free(poolStats.latency);
+
+    // workers are forked before the coordinator opens anything they could inherit
+    pid_t fake = 0;
+    if (withFake && !(fake = fork())) fake_worker();
+    pid_t workers[WORKERS];
+    KerrArgs local = *args;
+    local.numThreads = 2;
+    for (int i = 0; i < WORKERS; ++i) workers[i] = start_worker(&local, addr, withFake ? 300000 : 0);
+
+    Dist *dist = dist_init(args, addr, argc, argv);
+    int ok = dist != NULL;
+    DistStats stats = {0};
+    if (dist) {
+        for (int f = 0; f < FRAMES; ++f) {
+            args->pos[2] = -8 + f;
+            snprintf(fileName, sizeof(fileName), "/tmp/dist_test_%d.tga", f);
+            dist_submit(dist, args, fileName);
+        }
+        dist_close(dist, &stats);
+    }
+
+    int status;
+    for (int i = 0; i < WORKERS; ++i) {
+        waitpid(workers[i], &status, 0);
+        ok &= WIFEXITED(status) && !WEXITSTATUS(status);
+    }
+    if (fake) {
+        waitpid(fake, &status, 0);
+        ok &= WIFEXITED(status) && !WEXITSTATUS(status) && stats.lost == 1 && stats.reassigned >= 1;
+    }
+    for (int f = 0; f < FRAMES; ++f) {
+        snprintf(fileName, sizeof(fileName), "/tmp/dist_test_%d.tga", f);
+        snprintf(refName, sizeof(refName), "/tmp/dist_test_ref_%d.tga", f);
+        ok &= same_files(fileName, refName);
+        remove(fileName);
+        remove(refName);
+    }
+    ok &= stats.frames == FRAMES;
+    printf(
+        "%s: %s %s, %ld tiles from %ld workers, %ld handed out again, frames match the pool\n",
+        ok ? "PASS" : "FAIL", argv[1], addr, stats.tiles, stats.workers, stats.reassigned
+    );
+    free_args(args);
+    return ok;
+}
+
+
+int main() {
+    char *strips[] = {"rayt", "schwarz", "-q", "3", "-o", "tga", "-j", "json", NULL};
+    char *refined[] = {"rayt", "kerr", "-q", "3", "-o", "tga", "-k", "16", "-j", "json", NULL};
+    char tcp[64];
+    snprintf(tcp, sizeof(tcp), "127.0.0.1:%d", 40000 + getpid() % 20000);
+
+    int ok = run(8, strips, "unix:" SOCKET, true);
+    ok &= run(10, refined, tcp, false);
+    return ok ? 0 : 1;
+}
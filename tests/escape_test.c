@@ -0,0 +1,51 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "args.h"
+#include "render.h"
+#include "check.h"
+
+// the analytic continuation should land where integrating all the way does,
+// give or take the Euler integration's own error over the skipped stretch
+#define TOLERANCE 16
+#define MAX_OUTLIERS .005
+
+
+static int compare(KerrArgs *args, float escape) {
+    Renderer *rptr = render_init(args);
+    int numPx = args->width * args->height;
+    RenderStats fullStats = {0}, earlyStats = {0};
+    rptr->escape = 0.0F;
+    Pixel *full = check_render(args, rptr, &fullStats);
+    rptr->escape = escape;
+    Pixel *early = check_render(args, rptr, &earlyStats);
+
+    int outliers = check_diff(full, early, numPx, TOLERANCE).outliers;
+    int ok = outliers <= MAX_OUTLIERS * numPx && earlyStats.steps < fullStats.steps;
+    printf(
+        "%s: %s radius %4.1f at {%.2f, %.2f, %.2f}: %d of %d pixels off, %.1f%% of the steps\n",
+        ok ? "PASS" : "FAIL", args->integrator, escape, args->pos[0], args->pos[1], args->pos[2],
+        outliers, numPx, 100.0 * earlyStats.steps / fullStats.steps
+    );
+    free(full);
+    free(early);
+    render_free(rptr);
+    return ok;
+}
+
+
+int main() {
+    KerrArgs args = check_args("schwarz", "euler");
+    float cameras[3][3] = {{1.1, .1, -8}, {1.1, .1, .9}, {-3, .5, -8}};
+    char *integrators[2] = {"euler", "rk45"};
+
+    int ok = 1;
+    for (int c = 0; c < 3; ++c) {
+        for (int i = 0; i < 3; ++i) args.pos[i] = cameras[c][i];
+        for (int j = 0; j < 2; ++j) {
+            args.integrator = integrators[j];
+            ok &= compare(&args, 6.0F);
+            ok &= compare(&args, 20.0F);
+        }
+    }
+    return ok ? 0 : 1;
+}
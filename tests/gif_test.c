@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "args.h"
+#include "render.h"
+#include "gif.h"
+#include "tpool.h"
+
+#define FRAMES 3
+#define MEAN_ERROR 2.0 // per channel, over a rendered frame squeezed into 256 colours
+
+
+// what came back out of a gif
+typedef struct Decoded {
+    int width, height;
+    int frames;
+    int delay;
+    int loop;
+    Pixel *pixels; // every frame, one after another
+} Decoded;
+
+
+static int sub_blocks(const unsigned char *data, long len, long *pos, unsigned char *dest) {
+    // concatenates the sub-blocks at *pos, returning their length
+    int n = 0;
+    while (*pos < len && data[*pos]) {
+        int size = data[(*pos)++];
+        if (dest) memcpy(dest + n, data + *pos, size);
+        n += size;
+        *pos += size;
+    }
+    *pos += 1;
+    return n;
+}
+
+
+static int unlzw(const unsigned char *data, int len, int minSize, unsigned char *out, long numPx) {
+    static int prefix[4096];
+    static unsigned char suffix[4096], stack[4096];
+    int clear = 1 << minSize, size = minSize + 1, next = clear + 2, old = -1;
+    unsigned char first = 0;
+    long pos = 0, bit = 0;
+    while (bit + size <= 8L * len) {
+        int code = 0;
+        for (int i = 0; i < size; ++i, ++bit) code |= ((data[bit / 8] >> (bit % 8)) & 1) << i;
+        if (code == clear) {
+            size = minSize + 1;
+            next = clear + 2;
+            old = -1;
+            continue;
+        }
+        if (code == clear + 1) break;
+        if (code > next || (old < 0 && code >= clear)) return 0;
+
+        // unwind the string backwards, the entry not yet made being old plus its own first index
+        int sp = 0, cur = code;
+        if (code == next) {
+            stack[sp++] = first;
+            cur = old;
+        }
+        while (cur >= clear) {
+            stack[sp++] = suffix[cur];
+            cur = prefix[cur];
+        }
+        stack[sp++] = cur;
+        first = cur;
+        while (sp && pos < numPx) out[pos++] = stack[--sp];
+
+        if (old >= 0 && next < 4096) {
+            prefix[next] = old;
+            suffix[next] = first;
+            next += 1;
+            if (next == 1 << size && size < 12) size += 1;
+        }
+        old = code;
+    }
+    return pos == numPx;
+}
+
+
+static int decode(const char *fileName, Decoded *gif) {
+    FILE *f = fopen(fileName, "rb");
+    if (!f) return 0;
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    unsigned char *data = malloc(len);
+    len = fread(data, 1, len, f);
+    fclose(f);
+
+    *gif = (Decoded) {0};
+    gif->loop = -1;
+    int ok = len > 13 && !memcmp(data, "GIF89a", 6) && !(data[10] & 0x80);
+    gif->width = data[6] | data[7] << 8;
+    gif->height = data[8] | data[9] << 8;
+    long numPx = (long) gif->width * gif->height;
+    unsigned char *lzwData = malloc(len);
+    unsigned char *idx = malloc(numPx);
+    long pos = 13;
+    while (ok && pos < len && data[pos] != 0x3B) {
+        if (data[pos] == 0x21) {
+            // extensions: frame delay, and the netscape repeat count
+            int label = data[pos + 1];
+            pos += 2;
+            long body = pos;
+            sub_blocks(data, len, &pos, NULL);
+            if (label == 0xF9) gif->delay = data[body + 2] | data[body + 3] << 8;
+            if (label == 0xFF && !memcmp(data + body + 1, "NETSCAPE2.0", 11)) gif->loop = data[body + 14] | data[body + 15] << 8;
+        } else if (data[pos] == 0x2C) {
+            const unsigned char *desc = data + pos;
+            ok &= (desc[5] | desc[6] << 8) == gif->width && (desc[7] | desc[8] << 8) == gif->height && (desc[9] & 0x80);
+            const unsigned char *palette = desc + 10;
+            pos += 10 + (3 << ((desc[9] & 7) + 1));
+            int minSize = data[pos++];
+            int n = sub_blocks(data, len, &pos, lzwData);
+            ok &= unlzw(lzwData, n, minSize, idx, numPx);
+
+            gif->pixels = realloc(gif->pixels, (gif->frames + 1) * numPx * sizeof(Pixel));
+            Pixel *frame = gif->pixels + gif->frames * numPx;
+            for (long i = 0; i < numPx; ++i) frame[i] = (Pixel) {palette[3 * idx[i] + 2], palette[3 * idx[i] + 1], palette[3 * idx[i]]};
+            gif->frames += 1;
+        } else {
+            ok = 0;
+        }
+    }
+    ok &= pos < len && data[pos] == 0x3B;
+    free(data);
+    free(lzwData);
+    free(idx);
+    return ok;
+}
+
+
+// up to 256 colours, all far enough apart to get their own bucket, should
+// come back exactly, through however many times the lzw dictionary fills up
+static int check_exact() {
+    int width = 640, height = 400;
+    Pixel *buf = malloc(width * height * sizeof(Pixel));
+    unsigned int seed = 7;
+    for (int i = 0; i < width * height; ++i) {
+        seed = seed * 1103515245U + 12345U;
+        int c = (seed >> 16) & 255;
+        buf[i] = (Pixel) {(c & 7) * 32, ((c >> 3) & 7) * 32, (c >> 6) * 64};
+    }
+    ImgOpts opts = {.delay = 7, .loop = 3};
+    gif_save("/tmp/gif_test.gif", buf, width, height, &opts);
+
+    Decoded gif;
+    int ok = decode("/tmp/gif_test.gif", &gif) && gif.frames == 1 && gif.delay == 7 && gif.loop == 3;
+    ok &= ok && !memcmp(gif.pixels, buf, width * height * sizeof(Pixel));
+    printf("%s: %dx%d frame of 256 colours round trips exactly\n", ok ? "PASS" : "FAIL", width, height);
+    free(gif.pixels);
+    free(buf);
+    return ok;
+}
+
+
+// an animation made by the pool holds every frame, close to what was rendered
+static int check_pool(KerrArgs *args) {
+    int numPx = args->width * args->height;
+    Pixel *want = malloc(FRAMES * numPx * sizeof(Pixel));
+    for (int f = 0; f < FRAMES; ++f) {
+        args->pos[2] = -8 + f;
+        Renderer *rptr = render_init(args);
+        RenderStats stats = {0};
+        render_span(rptr, 0, numPx, want + f * numPx, &stats);
+        render_free(rptr);
+    }
+
+    TPool *pool = tpool_init(args);
+    for (int f = 0; f < FRAMES; ++f) {
+        args->pos[2] = -8 + f;
+        tpool_submit(pool, args, "/tmp/gif_test.gif");
+    }
+    PoolStats stats;
+    tpool_close(pool, &stats);
+    free(stats.latency);
+
+    Decoded gif;
+    int ok = decode("/tmp/gif_test.gif", &gif) && gif.frames == FRAMES && gif.delay == args->delay && gif.loop == args->loop;
+    double error = 0.0;
+    for (long i = 0; ok && i < (long) FRAMES * numPx; ++i) {
+        error += abs(gif.pixels[i].r - want[i].r) + abs(gif.pixels[i].g - want[i].g) + abs(gif.pixels[i].b - want[i].b);
+    }
+    error /= 3.0 * FRAMES * numPx;
+    ok &= error < MEAN_ERROR;
+    printf("%s: %d frames from %d threads decode, %.2f mean error per channel\n", ok ? "PASS" : "FAIL", gif.frames, args->numThreads, error);
+    free(gif.pixels);
+    free(want);
+    return ok;
+}
+
+
+int main() {
+    KerrArgs args = {
+        .pos = {1.1, .1, -8},
+        .dir = {0, 0, 1},
+        .fov = 90,
+        .width = 96,
+        .height = 54,
+        .taskSize = 512,
+        .numThreads = 3,
+        .integrator = "euler",
+        .tol = 1e-5,
+        .tileOrder = "row",
+        .packetWidth = -1,
+        .refine = -1,
+        .escape = 6,
+        .num_steps = FRAMES,
+        .format = "gif",
+        .delay = 5,
+        .loop = 0,
+        .report = "text",
+        .scene = "schwarz"
+    };
+
+    int ok = check_exact();
+    ok &= check_pool(&args);
+    remove("/tmp/gif_test.gif");
+    return ok ? 0 : 1;
+}
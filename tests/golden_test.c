@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "args.h"
+#include "tpool.h"
+#include "check.h"
+
+#define GOLDEN_DIR "tests/golden/"
+#define OUT "/tmp/golden_test.tga"
+#define TGA_HEAD 18
+#define GOLDEN_TOLERANCE 8 // channel levels a pixel may drift from its golden value
+#define GOLDEN_OUTLIERS 0.01 // share of pixels allowed past that, where an orbit flips between fates
+
+
+// a golden frame and the ways of rendering it that must all land on it
+typedef struct GoldenCase {
+    const char *name;
+    char *argv[16];
+} GoldenCase;
+
+
+static const GoldenCase CASES[] = {
+    {"schwarz", {"rayt", "schwarz", "-q", "3", "-o", "tga", "-n", "1", "-p", "0", "-j", "json", NULL}},
+    {"schwarz", {"rayt", "schwarz", "-q", "3", "-o", "tga", "-n", "3", "-p", "-1", "-j", "json", NULL}},
+    {"schwarz", {"rayt", "schwarz", "-q", "3", "-o", "tga", "-n", "3", "-g", "16x16", "-r", "morton", "-j", "json", NULL}},
+    {"schwarz", {"rayt", "schwarz", "-q", "3", "-o", "tga", "-n", "2", "-s", "97", "-d", "3", "-j", "json", NULL}},
+    {"sphere", {"rayt", "sphere", "-q", "3", "-o", "tga", "-n", "1", "-j", "json", NULL}},
+    {"sphere", {"rayt", "sphere", "-q", "3", "-o", "tga", "-n", "3", "-g", "16x16", "-r", "hilbert", "-j", "json", NULL}}
+};
+#define NUM_CASES (int) (sizeof(CASES) / sizeof(CASES[0]))
+
+
+static unsigned char *load(const char *fileName, long *len) {
+    FILE *f = fopen(fileName, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    unsigned char *out = malloc(*len);
+    *len = fread(out, 1, *len, f);
+    fclose(f);
+    return out;
+}
+
+
+// renders the middle frame of the case's camera path through the pool
+static void render_case(const GoldenCase *gc, const char *fileName) {
+    // getopt shuffles the array it's given, so it gets a copy
+    char *argv[16];
+    int argc = 0;
+    while ((argv[argc] = gc->argv[argc])) argc += 1;
+    KerrArgs *args = parse_args(argc, argv);
+    for (int j = 0; j < 3; ++j) args->pos[j] = (args->pos0[j] + args->pos1[j]) / 2;
+    args->step = 1;
+    TPool *pool = tpool_init(args);
+    tpool_submit(pool, args, fileName);
+    PoolStats stats;
+    tpool_close(pool, &stats);
+    free(stats.latency);
+    free_args(args);
+}
+
+
+static int check(const GoldenCase *gc) {
+    char golden[64];
+    snprintf(golden, sizeof(golden), GOLDEN_DIR "%s.tga", gc->name);
+    render_case(gc, OUT);
+    long goldLen, outLen;
+    unsigned char *gold = load(golden, &goldLen);
+    unsigned char *out = load(OUT, &outLen);
+    if (!gold || !out || goldLen != outLen || memcmp(gold, out, TGA_HEAD)) {
+        printf("FAIL: %s can't be compared with %s\n", OUT, golden);
+        free(gold);
+        free(out);
+        return 0;
+    }
+
+    int numPx = (goldLen - TGA_HEAD) / sizeof(Pixel);
+    PixelDiff diff = check_diff((Pixel *) (gold + TGA_HEAD), (Pixel *) (out + TGA_HEAD), numPx, GOLDEN_TOLERANCE);
+    free(gold);
+    free(out);
+
+    char flags[128] = "";
+    for (int i = 2; gc->argv[i] && strcmp(gc->argv[i], "-j"); ++i) {
+        strncat(flags, " ", sizeof(flags) - strlen(flags) - 1);
+        strncat(flags, gc->argv[i], sizeof(flags) - strlen(flags) - 1);
+    }
+    int ok = diff.outliers <= GOLDEN_OUTLIERS * numPx;
+    printf(
+        "%s: %s%s within %d of golden but for %d of %d pixels (worst %d)\n",
+        ok ? "PASS" : "FAIL", gc->name, flags, GOLDEN_TOLERANCE, diff.outliers, numPx, diff.worst
+    );
+    return ok;
+}
+
+
+// "update" renders each scene's first case into the golden files instead of
+// checking against them, for when a change is meant to alter the pictures
+int main(int argc, char **argv) {
+    if (argc > 1 && !strcmp(argv[1], "update")) {
+        for (int c = 0; c < NUM_CASES; ++c) {
+            if (c && !strcmp(CASES[c].name, CASES[c - 1].name)) continue;
+            char golden[64];
+            snprintf(golden, sizeof(golden), GOLDEN_DIR "%s.tga", CASES[c].name);
+            render_case(CASES + c, golden);
+            printf("wrote %s\n", golden);
+        }
+        return 0;
+    }
+
+    int ok = 1;
+    for (int c = 0; c < NUM_CASES; ++c) ok &= check(CASES + c);
+    remove(OUT);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "args.h"
+#include "render.h"
+#include "tga.h"
+#include "tpool.h"
+
+#define WIDE 1200 // wide enough for four digit coordinates
+#define TALL 40
+
+
+static char *slurp(const char *fileName, long *len) {
+    FILE *f = fopen(fileName, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *out = malloc(*len + 1);
+    *len = fread(out, 1, *len, f);
+    fclose(f);
+    return out;
+}
+
+
+// the encoder as it used to be, one sprintf per pixel
+static long reference(char *dest, const Pixel *buf, int width, int height) {
+    long len = sprintf(dest, "newgraph\nxaxis size 4.8 nodraw\nyaxis size 2.7 nodraw\n\n");
+    for (int i = 0; i < width * height; ++i) {
+        int pxID = width * height - 1 - i;
+        int x = width - 1 - pxID % width;
+        int y = pxID / width;
+        len += sprintf(dest + len, "newline poly pts %d %d  %d %d  %d %d  %d %d color %.2f %.2f %.2f\n",
+            x, y, x + 1, y, x + 1, y + 1, x, y + 1,
+            buf[i].r / 255., buf[i].g / 255., buf[i].b / 255.
+        );
+    }
+    return len;
+}
+
+
+static int same_file(const char *fileName, const char *want, long wantLen) {
+    long len;
+    char *got = slurp(fileName, &len);
+    int same = got && len == wantLen && !memcmp(got, want, len);
+    free(got);
+    return same;
+}
+
+
+// every channel value and coordinate width against the sprintf encoder
+static int check_reference() {
+    Pixel *buf = malloc(WIDE * TALL * sizeof(Pixel));
+    for (int i = 0; i < WIDE * TALL; ++i) buf[i] = (Pixel) {i % 256, (i / 256) % 256, (i * 7) % 256};
+    char *want = malloc(jgr_bound(WIDE, TALL, TALL) + 256);
+    long wantLen = reference(want, buf, WIDE, TALL);
+
+    ImgOpts opts = {.merge = 0};
+    jgr_save("/tmp/jgr_test.jgr", buf, WIDE, TALL, &opts);
+    int ok = same_file("/tmp/jgr_test.jgr", want, wantLen);
+    printf("%s: %dx%d frame matches the sprintf encoder byte for byte\n", ok ? "PASS" : "FAIL", WIDE, TALL);
+    free(buf);
+    free(want);
+    return ok;
+}
+
+
+// row bands formatted apart and joined must give the whole frame
+static int check_bands(int merge) {
+    Pixel *buf = malloc(WIDE * TALL * sizeof(Pixel));
+    for (int i = 0; i < WIDE * TALL; ++i) buf[i] = (Pixel) {(i / 37) % 3 * 100, (i / WIDE) % 2 * 200, 0};
+    long cap = jgr_bound(WIDE, TALL, TALL);
+    char *whole = malloc(cap);
+    char *joined = malloc(cap);
+    long prims = 0, bandPrims = 0;
+    long len = jgr_encode(whole, buf, WIDE, TALL, 0, TALL, merge, &prims);
+    long joinedLen = 0;
+    for (int y = 0; y < TALL; y += 7) {
+        joinedLen += jgr_encode(joined + joinedLen, buf, WIDE, TALL, y, y + 7 < TALL ? y + 7 : TALL, merge, &bandPrims);
+    }
+
+    int ok = len == joinedLen && !memcmp(whole, joined, len) && prims == bandPrims;
+    printf("%s: merge %d bands joined match the whole frame (%ld rectangles)\n", ok ? "PASS" : "FAIL", merge, prims);
+    free(buf);
+    free(whole);
+    free(joined);
+    return ok;
+}
+
+
+// frames formatted on the pool's workers against jgr_save on the same image
+static int check_pool(KerrArgs *args) {
+    Renderer *rptr = render_init(args);
+    int numPx = args->width * args->height;
+    Pixel *image = malloc(numPx * sizeof(Pixel));
+    RenderStats stats = {0};
+    render_span(rptr, 0, numPx, image, &stats);
+    render_free(rptr);
+    ImgOpts opts = {.merge = args->merge};
+    jgr_save("/tmp/jgr_test.jgr", image, args->width, args->height, &opts);
+    long wantLen;
+    char *want = slurp("/tmp/jgr_test.jgr", &wantLen);
+
+    TPool *pool = tpool_init(args);
+    tpool_submit(pool, args, "/tmp/jgr_test_pool.jgr");
+    PoolStats poolStats;
+    tpool_close(pool, &poolStats);
+    free(poolStats.latency);
+
+    int ok = same_file("/tmp/jgr_test_pool.jgr", want, wantLen) && poolStats.prims == opts.prims;
+    printf("%s: merge %d on %d threads matches jgr_save\n", ok ? "PASS" : "FAIL", args->merge, args->numThreads);
+    free(image);
+    free(want);
+    return ok;
+}
+
+
+int main() {
+    KerrArgs args = {
+        .pos = {1.1, .1, -8},
+        .dir = {0, 0, 1},
+        .fov = 90,
+        .width = 96,
+        .height = 54,
+        .taskSize = 512,
+        .numThreads = 3,
+        .integrator = "euler",
+        .tol = 1e-5,
+        .tileOrder = "row",
+        .packetWidth = -1,
+        .refine = -1,
+        .escape = 6,
+        .num_steps = 1,
+        .format = "jgr",
+        .report = "text",
+        .scene = "schwarz"
+    };
+
+    int ok = check_reference();
+    ok &= check_bands(0);
+    ok &= check_bands(1);
+    for (int merge = 0; merge <= 2; ++merge) {
+        args.merge = merge;
+        ok &= check_pool(&args);
+    }
+
+    remove("/tmp/jgr_test.jgr");
+    remove("/tmp/jgr_test_pool.jgr");
+    return ok ? 0 : 1;
+}
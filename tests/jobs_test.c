@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "jobs.h"
+
+#define NUM_JOBS 6
+#define JOB_SECONDS .2
+
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+// NUM_JOBS sleeping jobs through a runner of width max; every one of them
+// must have finished by the time jobs_close returns
+static double run(int max, long *failed) {
+    char cmd[256], label[64];
+    double t0 = now();
+    Jobs *jobs = jobs_init(max);
+    for (int i = 0; i < NUM_JOBS; ++i) {
+        snprintf(cmd, sizeof(cmd), "sleep %g && touch /tmp/jobs_test_%d", JOB_SECONDS, i);
+        snprintf(label, sizeof(label), "job %d", i);
+        jobs_run(jobs, cmd, label);
+    }
+    *failed = jobs_close(jobs, NULL, NULL);
+    return now() - t0;
+}
+
+
+static int all_done() {
+    int done = 1;
+    char fileName[64];
+    for (int i = 0; i < NUM_JOBS; ++i) {
+        snprintf(fileName, sizeof(fileName), "/tmp/jobs_test_%d", i);
+        done &= !access(fileName, F_OK);
+        remove(fileName);
+    }
+    return done;
+}
+
+
+int main() {
+    int ok = 1;
+
+    // never more than max at once, so the runs take at least this many rounds
+    int widths[2] = {2, 3};
+    for (int w = 0; w < 2; ++w) {
+        long failed;
+        double took = run(widths[w], &failed);
+        double least = (NUM_JOBS + widths[w] - 1) / widths[w] * JOB_SECONDS;
+        int pass = took >= least * .95 && !failed && all_done();
+        printf("%s: %d jobs %d at a time took %.2fs, at least %.2fs\n", pass ? "PASS" : "FAIL", NUM_JOBS, widths[w], took, least);
+        ok &= pass;
+    }
+
+    // failures are counted, not fatal
+    Jobs *jobs = jobs_init(2);
+    jobs_run(jobs, "exit 3", "failing job");
+    jobs_run(jobs, "true", "passing job");
+    jobs_run(jobs, "false", "failing job");
+    long started;
+    long failed = jobs_close(jobs, &started, NULL);
+    int pass = started == 3 && failed == 2;
+    printf("%s: %ld of %ld jobs failed\n", pass ? "PASS" : "FAIL", failed, started);
+    ok &= pass;
+
+    // a child the runner didn't start, ending while it waits, is left to its parent
+    pid_t other = fork();
+    if (!other) {
+        usleep(50000);
+        _exit(7);
+    }
+    jobs = jobs_init(1);
+    jobs_run(jobs, "sleep .1", "job");
+    jobs_run(jobs, "sleep .1", "job");
+    failed = jobs_close(jobs, NULL, NULL);
+    int status;
+    pass = !failed && waitpid(other, &status, 0) == other && WIFEXITED(status) && WEXITSTATUS(status) == 7;
+    printf("%s: another child's exit status is still there for its own waitpid\n", pass ? "PASS" : "FAIL");
+    ok &= pass;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "args.h"
+#include "render.h"
+#include "check.h"
+
+// without spin the kerr scene is the schwarzschild one traced another way, so
+// it should land within the adaptive integrators' own error of rk45's picture
+#define TOLERANCE 16
+#define MAX_OUTLIERS .01
+
+
+static int compare(KerrArgs *args) {
+    int numPx = args->width * args->height;
+    RenderStats schwarzStats = {0}, kerrStats = {0};
+    args->scene = "schwarz";
+    Pixel *schwarz = check_render(args, NULL, &schwarzStats);
+    args->scene = "kerr";
+    args->spin = 0.0F;
+    Pixel *kerr = check_render(args, NULL, &kerrStats);
+
+    int outliers = check_diff(schwarz, kerr, numPx, TOLERANCE).outliers;
+    int ok = outliers <= MAX_OUTLIERS * numPx;
+    printf(
+        "%s: spin 0 at {%.2f, %.2f, %.2f}: %d of %d pixels off, %.1f steps per ray\n",
+        ok ? "PASS" : "FAIL", args->pos[0], args->pos[1], args->pos[2],
+        outliers, numPx, kerrStats.steps / (double) kerrStats.rays
+    );
+    free(schwarz);
+    free(kerr);
+    return ok;
+}
+
+
+// the spinning hole's shadow is pushed to the side whose photons orbit against
+// the spin, so its middle moves across the picture as the spin goes up
+static float shadow_middle(KerrArgs *args, float spin) {
+    RenderStats stats = {0};
+    args->scene = "kerr";
+    args->spin = spin;
+    Pixel *frame = check_render(args, NULL, &stats);
+    double sum = 0.0;
+    long count = 0;
+    for (int i = 0; i < args->width * args->height; ++i) {
+        if (frame[i].r || frame[i].g || frame[i].b) continue;
+        sum += i % args->width;
+        count += 1;
+    }
+    free(frame);
+    return count ? sum / count : -1.0F;
+}
+
+
+// with escape off, photons that make it out of a far camera's view are still
+// carried on out rather than ending nowhere and counting as fallen in
+static int check_no_escape(KerrArgs *args) {
+    float pos[3] = {0, .5, -100};
+    for (int i = 0; i < 3; ++i) args->pos[i] = pos[i];
+    args->scene = "kerr";
+    args->spin = .9F;
+    args->escape = 0;
+    RenderStats stats = {0};
+    free(check_render(args, NULL, &stats));
+    args->escape = 6;
+    int ok = stats.rays && stats.fates[HORIZON] < stats.rays / 2;
+    printf("%s: -E 0 from {0, .5, -100}: %ld of %ld rays fell in\n", ok ? "PASS" : "FAIL", stats.fates[HORIZON], stats.rays);
+    return ok;
+}
+
+
+int main() {
+    KerrArgs args = check_args("schwarz", "rk45");
+    float cameras[3][3] = {{1.1, .1, -8}, {-3, .5, -8}, {0, 2, -5}};
+
+    int ok = 1;
+    for (int c = 0; c < 3; ++c) {
+        for (int i = 0; i < 3; ++i) args.pos[i] = cameras[c][i];
+        ok &= compare(&args);
+    }
+
+    for (int i = 0; i < 3; ++i) args.pos[i] = cameras[0][i];
+    float still = shadow_middle(&args, 0.0F);
+    float spun = shadow_middle(&args, .99F);
+    int shifted = still >= 0.0F && spun >= 0.0F && spun - still > 1.0F;
+    printf("%s: shadow middle at column %.1f without spin, %.1f at spin .99\n", shifted ? "PASS" : "FAIL", still, spun);
+    ok &= shifted;
+    ok &= check_no_escape(&args);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "args.h"
+#include "manifest.h"
+#include "tpool.h"
+
+#define FRAMES 5
+#define MANIFEST "/tmp/manifest_test"
+#define GIF "/tmp/manifest_test.gif"
+#define WHOLE "/tmp/manifest_test_whole.gif"
+
+
+static long file_size(const char *fileName) {
+    struct stat st;
+    return stat(fileName, &st) ? -1 : st.st_size;
+}
+
+
+// frames recorded by one run are done for the next with the same settings only
+static int check_resume(KerrArgs *args) {
+    Manifest *man = manifest_open(args, MANIFEST, false);
+    FILE *f = fopen(GIF, "w");
+    fputs("frame", f);
+    fclose(f);
+    manifest_record(man, 0, GIF);
+    manifest_record(man, 2, GIF);
+    manifest_close(man);
+
+    // a frame the manifest never heard about gets cut off again
+    f = fopen(GIF, "a");
+    fputs(" and some", f);
+    fclose(f);
+    man = manifest_open(args, MANIFEST, true);
+    int ok = man && manifest_done(man, 0) && !manifest_done(man, 1) && manifest_done(man, 2) && manifest_count(man) == 2;
+    ok &= file_size(GIF) == 5;
+    manifest_close(man);
+    printf("%s: resumed run sees frames 0 and 2 done, file cut back to %ld bytes\n", ok ? "PASS" : "FAIL", file_size(GIF));
+
+    args->spin = .5;
+    man = manifest_open(args, MANIFEST, true);
+    int refused = !man;
+    manifest_close(man);
+    args->spin = .9;
+    printf("%s: a different spin can't resume from it\n", refused ? "PASS" : "FAIL");
+    return ok && refused;
+}
+
+
+static void render(KerrArgs *args, const char *fileName, Manifest *man, int stop) {
+    TPool *pool = tpool_init(args);
+    if (man) tpool_manifest(pool, man);
+    for (int f = 0; f < stop; ++f) {
+        if (man && manifest_done(man, f)) continue;
+        args->pos[2] = -8 + f;
+        args->step = f;
+        tpool_submit(pool, args, fileName);
+    }
+    PoolStats stats;
+    tpool_close(pool, &stats);
+    free(stats.latency);
+}
+
+
+// an animation stopped part way and resumed is the one rendered in one go
+static int check_gif(KerrArgs *args) {
+    render(args, WHOLE, NULL, FRAMES);
+
+    Manifest *man = manifest_open(args, MANIFEST, false);
+    render(args, GIF, man, 2);
+    manifest_close(man);
+    man = manifest_open(args, MANIFEST, true);
+    long resumed = man ? manifest_count(man) : -1;
+    if (man) render(args, GIF, man, FRAMES);
+    manifest_close(man);
+
+    char cmd[256];
+    snprintf(cmd, sizeof(cmd), "cmp -s %s %s", GIF, WHOLE);
+    int ok = resumed == 2 && !system(cmd);
+    printf("%s: gif resumed after %ld of %d frames matches one rendered straight through\n", ok ? "PASS" : "FAIL", resumed, FRAMES);
+    return ok;
+}
+
+
+int main() {
+    KerrArgs args = {
+        .pos = {1.1, .1, -8},
+        .dir = {0, 0, 1},
+        .fov = 90,
+        .width = 96,
+        .height = 54,
+        .taskSize = 512,
+        .numThreads = 3,
+        .integrator = "euler",
+        .tol = 1e-5,
+        .tileOrder = "row",
+        .packetWidth = -1,
+        .refine = -1,
+        .escape = 6,
+        .spin = .9,
+        .num_steps = FRAMES,
+        .format = "gif",
+        .delay = 2,
+        .report = "text",
+        .scene = "schwarz"
+    };
+
+    int ok = check_resume(&args);
+    ok &= check_gif(&args);
+    remove(MANIFEST);
+    remove(GIF);
+    remove(WHOLE);
+    return ok ? 0 : 1;
+}
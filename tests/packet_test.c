@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "args.h"
+#include "render.h"
+#include "packet.h"
+#include "check.h"
+
+// fraction of pixels allowed to differ by more than TOLERANCE levels, for
+// orbits skimming the photon sphere where float rounding decides their fate
+#define TOLERANCE 8
+#define MAX_OUTLIERS .005
+
+
+static int compare(KerrArgs *args, int width) {
+    Renderer *rptr = render_init(args);
+    int numPx = args->width * args->height;
+    RenderStats stats = {0};
+    rptr->packetWidth = 0;
+    Pixel *scalar = check_render(args, rptr, &stats);
+    rptr->packetWidth = width;
+    Pixel *packed = check_render(args, rptr, &stats);
+
+    int outliers = check_diff(scalar, packed, numPx, TOLERANCE).outliers;
+    int ok = outliers <= MAX_OUTLIERS * numPx;
+    printf(
+        "%s: width %2d at {%.2f, %.2f, %.2f}: %d of %d pixels off\n",
+        ok ? "PASS" : "FAIL", width, args->pos[0], args->pos[1], args->pos[2], outliers, numPx
+    );
+    free(scalar);
+    free(packed);
+    render_free(rptr);
+    return ok;
+}
+
+
+int main() {
+    KerrArgs args = check_args("schwarz", "euler");
+    args.escape = 0;
+    float cameras[3][3] = {{1.1, .1, -8}, {1.1, .1, -3}, {-.5, .3, 0}};
+
+    int supported = packet_width();
+    if (!supported) {
+        printf("SKIP: no SIMD packet support on this cpu\n");
+        return 0;
+    }
+
+    int ok = 1;
+    for (int c = 0; c < 3; ++c) {
+        for (int i = 0; i < 3; ++i) args.pos[i] = cameras[c][i];
+        for (int width = 8; width <= supported; width *= 2) ok &= compare(&args, width);
+    }
+    return ok ? 0 : 1;
+}
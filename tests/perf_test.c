@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "args.h"
+#include "tpool.h"
+
+#define PERF_FRAMES 4 // frames along each workload's camera path
+#define PERF_RUNS 3 // runs of each workload, of which the fastest counts
+
+
+// a fixed render, as the flags that set it up and the size to render it at
+typedef struct PerfCase {
+    const char *name;
+    int width;
+    int height;
+    char *argv[16];
+} PerfCase;
+
+
+static const PerfCase CASES[] = {
+    {"schwarz-packets", 192, 108, {"rayt", "schwarz", "-n", "1", "-j", "json", NULL}},
+    {"schwarz-scalar", 96, 54, {"rayt", "schwarz", "-n", "1", "-p", "0", "-j", "json", NULL}},
+    {"schwarz-rk45", 192, 108, {"rayt", "schwarz", "-n", "1", "-i", "rk45", "-j", "json", NULL}},
+    {"sphere", 384, 216, {"rayt", "sphere", "-n", "1", "-j", "json", NULL}},
+    {"kerr", 96, 54, {"rayt", "kerr", "-n", "1", "-j", "json", NULL}},
+    {"pool-tiles", 384, 216, {"rayt", "schwarz", "-g", "16x16", "-r", "hilbert", "-j", "json", NULL}}
+};
+#define NUM_CASES (int) (sizeof(CASES) / sizeof(CASES[0]))
+
+
+// rays per second of the fastest of PERF_RUNS renders of the workload
+static double measure(const PerfCase *pc) {
+    char *argv[16];
+    int argc = 0;
+    while ((argv[argc] = pc->argv[argc])) argc += 1;
+    KerrArgs *args = parse_args(argc, argv);
+    args->width = pc->width;
+    args->height = pc->height;
+    args->num_steps = PERF_FRAMES;
+    args->format = "none";
+
+    double best = 0.0;
+    for (int r = 0; r < PERF_RUNS; ++r) {
+        TPool *pool = tpool_init(args);
+        for (int i = 0; i < PERF_FRAMES; ++i) {
+            for (int j = 0; j < 3; ++j) args->pos[j] = args->pos0[j] + (args->pos1[j] - args->pos0[j]) * i / PERF_FRAMES;
+            args->step = i;
+            tpool_submit(pool, args, "perf");
+        }
+        PoolStats stats;
+        tpool_close(pool, &stats);
+        free(stats.latency);
+        double rate = stats.rays / stats.seconds;
+        if (rate > best) best = rate;
+    }
+    free_args(args);
+    return best;
+}
+
+
+static double baseline(const char *fileName, const char *name) {
+    FILE *f = fopen(fileName, "r");
+    if (!f) return 0.0;
+    char line[256], key[64];
+    double rate, out = 0.0;
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#' || sscanf(line, "%63s %lf", key, &rate) != 2) continue;
+        if (!strcmp(key, name)) out = rate;
+    }
+    fclose(f);
+    return out;
+}
+
+
+// "record FILE" writes this machine's rates as the baseline; "FILE SLACK"
+// fails any workload more than SLACK percent slower than its baseline
+int main(int argc, char **argv) {
+    if (argc == 3 && !strcmp(argv[1], "record")) {
+        FILE *f = fopen(argv[2], "w");
+        if (!f) {
+            fprintf(stderr, "Error: failed to open \"%s\"\n", argv[2]);
+            return 1;
+        }
+        fprintf(f, "# rays per second of each make perf workload, from make perf-baseline\n");
+        for (int c = 0; c < NUM_CASES; ++c) {
+            double rate = measure(CASES + c);
+            fprintf(f, "%s %.0f\n", CASES[c].name, rate);
+            printf("%s: %.3fM rays/s\n", CASES[c].name, rate / 1e6);
+        }
+        fclose(f);
+        return 0;
+    }
+
+    float slack;
+    if (argc != 3 || sscanf(argv[2], "%f", &slack) != 1 || slack < 0) {
+        fprintf(stderr, "Usage: %s BASELINE SLACK | record BASELINE\n", argv[0]);
+        return 1;
+    }
+    int ok = 1;
+    for (int c = 0; c < NUM_CASES; ++c) {
+        double base = baseline(argv[1], CASES[c].name);
+        double rate = measure(CASES + c);
+        if (base <= 0) {
+            printf("FAIL: %s at %.3fM rays/s has no baseline in %s\n", CASES[c].name, rate / 1e6, argv[1]);
+            ok = 0;
+            continue;
+        }
+        double change = 100.0 * (rate / base - 1);
+        int fast = change >= -slack;
+        printf(
+            "%s: %s at %.3fM rays/s, %+.1f%% against %.3fM\n",
+            fast ? "PASS" : "FAIL", CASES[c].name, rate / 1e6, change, base / 1e6
+        );
+        ok &= fast;
+    }
+    return ok ? 0 : 1;
+}
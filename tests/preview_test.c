@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "args.h"
+#include "render.h"
+#include "tga.h"
+#include "preview.h"
+
+#define ROOT "/tmp/preview_test"
+#define PREVIEW "data/preview.tga"
+#define TGA_HEAD 18
+
+
+// runs a preview with its per-pass report out of the way of the test's own
+static int run_quiet(KerrArgs *args) {
+    fflush(stdout);
+    int saved = dup(1);
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, 1);
+    close(null);
+    int ret = preview_run(args);
+    fflush(stdout);
+    dup2(saved, 1);
+    close(saved);
+    return ret;
+}
+
+
+static Pixel *load_tga(const char *fileName, int numPx) {
+    FILE *f = fopen(fileName, "rb");
+    if (!f) return NULL;
+    Pixel *image = malloc(numPx * sizeof(Pixel));
+    int ok = fseek(f, TGA_HEAD, SEEK_SET) == 0 && fread(image, sizeof(Pixel), numPx, f) == (size_t) numPx;
+    fclose(f);
+    if (!ok) {
+        free(image);
+        return NULL;
+    }
+    return image;
+}
+
+
+static Pixel *render_ref(KerrArgs *args, const char *fileName) {
+    Renderer *rptr = render_init(args);
+    int numPx = args->width * args->height;
+    Pixel *ref = malloc(numPx * sizeof(Pixel));
+    RenderStats stats = {0};
+    render_span(rptr, 0, numPx, ref, &stats);
+    render_free(rptr);
+    ImgOpts opts = {.merge = args->merge};
+    tga_save(fileName, ref, args->width, args->height, &opts);
+    return ref;
+}
+
+
+// every pass traces its pixels exactly as a plain render does, so once the
+// last one is in the preview is the full image, packets or not
+static int check_full(KerrArgs *args) {
+    int ok = 1;
+    int widths[] = {-1, 0};
+    for (int w = 0; w < 2; ++w) {
+        args->packetWidth = widths[w];
+        args->passes = PREVIEW_PASSES;
+        free(render_ref(args, "ref.tga"));
+        remove(PREVIEW);
+        int ret = run_quiet(args);
+        int same = !ret && !system("cmp -s " ROOT "/ref.tga " ROOT "/" PREVIEW);
+        printf("%s: %d passes %s packets end on the full render\n", same ? "PASS" : "FAIL", PREVIEW_PASSES, widths[w] ? "with" : "without");
+        ok &= same;
+    }
+    args->packetWidth = -1;
+    return ok;
+}
+
+
+// an early stop leaves the traced grid as it would be in the full render and
+// fills the rest in, whether it stops on the pass count or the clock
+static int check_partial(KerrArgs *args, const Pixel *ref) {
+    int numPx = args->width * args->height;
+    args->passes = 1;
+    remove(PREVIEW);
+    run_quiet(args);
+    Pixel *image = load_tga(PREVIEW, numPx);
+    int grid = image != NULL, filled = 0;
+    for (int y = 0; image && y < args->height; ++y) {
+        for (int x = 0; x < args->width; ++x) {
+            const Pixel *a = image + y * args->width + x, *b = ref + y * args->width + x;
+            bool same = a->r == b->r && a->g == b->g && a->b == b->b;
+            if (x % PREVIEW_STRIDE == 0 && y % PREVIEW_STRIDE == 0) grid &= same;
+            else filled += !same;
+        }
+    }
+    free(image);
+    int ok = grid && filled > 0;
+    printf("%s: one pass keeps the %dx%d grid and fills the rest (%d pixels differ)\n", ok ? "PASS" : "FAIL", PREVIEW_STRIDE, PREVIEW_STRIDE, filled);
+
+    rename(PREVIEW, "first.tga");
+    args->passes = 0;
+    args->passTime = 1e-6;
+    run_quiet(args);
+    args->passTime = 0;
+    int timed = !system("cmp -s " ROOT "/first.tga " ROOT "/" PREVIEW);
+    printf("%s: a time limit that's up at once stops after the first pass\n", timed ? "PASS" : "FAIL");
+    return ok && timed;
+}
+
+
+int main() {
+    KerrArgs args = {
+        .pos = {1.1, .1, -8},
+        .pos0 = {1.1, .1, -8},
+        .dir = {0, 0, 1},
+        .fov = 90,
+        .width = 96,
+        .height = 54,
+        .taskSize = 512,
+        .numThreads = 3,
+        .integrator = "euler",
+        .tol = 1e-5,
+        .tileOrder = "row",
+        .packetWidth = -1,
+        .refine = -1,
+        .escape = 6,
+        .num_steps = 1,
+        .format = "tga",
+        .report = "text",
+        .scene = "schwarz"
+    };
+
+    system("rm -rf " ROOT);
+    mkdir(ROOT, 0700);
+    if (chdir(ROOT)) return 1;
+    mkdir("data", 0700);
+
+    int ok = check_full(&args);
+    Pixel *ref = render_ref(&args, "ref.tga");
+    ok &= check_partial(&args, ref);
+
+    free(ref);
+    system("rm -rf " ROOT);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "args.h"
+#include "render.h"
+#include "tga.h"
+#include "topo.h"
+#include "tpool.h"
+
+#define ROOT "/tmp/topo_test"
+
+
+static void put_file(const char *path, const char *text) {
+    char full[512];
+    snprintf(full, sizeof(full), "%s%s", ROOT, path);
+    // make every directory on the way
+    for (char *slash = strchr(full + 1, '/'); slash; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        mkdir(full, 0777);
+        *slash = '/';
+    }
+    FILE *f = fopen(full, "w");
+    fputs(text, f);
+    fclose(f);
+}
+
+
+// a two socket machine with eight cpus a node, of which the process may
+// use four on each, under a quota of two and a half cpus
+static int check_detect() {
+    put_file("/sys/devices/system/node/node0/cpulist", "0-7\n");
+    put_file("/sys/devices/system/node/node1/cpulist", "8-15\n");
+    put_file("/sys/fs/cgroup/cpu.max", "250000 100000\n");
+    int allowed[] = {2, 3, 4, 5, 10, 11, 12, 13};
+    Topology topo;
+    topo_detect(&topo, ROOT, allowed, 8);
+
+    int ok = topo.numCpus == 8 && topo.numNodes == 2 && topo.nodes[0] == 0 && topo.nodes[1] == 1;
+    ok &= topo.nodeStart[1] == 4 && topo.cpus[0] == 2 && topo.cpus[4] == 10;
+    ok &= topo.quota == 2.5 && topo_threads(&topo) == 2;
+    printf("%s: %d cpus on %d nodes, quota %.2f gives %d threads\n", ok ? "PASS" : "FAIL", topo.numCpus, topo.numNodes, topo.quota, topo_threads(&topo));
+
+    // with the quota lifted every usable cpu gets a thread
+    put_file("/sys/fs/cgroup/cpu.max", "max 100000\n");
+    topo_detect(&topo, ROOT, allowed, 8);
+    int lifted = topo.quota == 0.0 && topo_threads(&topo) == 8;
+    printf("%s: no quota gives %d threads\n", lifted ? "PASS" : "FAIL", topo_threads(&topo));
+    return ok && lifted;
+}
+
+
+// workers split between the nodes, each on a cpu of its own node when bound to cores
+static int check_place() {
+    int allowed[] = {2, 3, 4, 5, 10, 11, 12, 13};
+    Topology topo;
+    topo_detect(&topo, ROOT, allowed, 8);
+    Placement place[6];
+
+    int groups = topo_place(&topo, 6, "core", place);
+    int ok = groups == 2;
+    int perNode[2] = {0, 0};
+    for (int i = 0; i < 6; ++i) {
+        ok &= place[i].node == place[i].group && place[i].cpu >= 0;
+        ok &= place[i].node ? place[i].cpu >= 10 : place[i].cpu < 8;
+        for (int j = 0; j < i; ++j) ok &= place[i].cpu != place[j].cpu;
+        perNode[place[i].node] += 1;
+    }
+    ok &= perNode[0] == 3 && perNode[1] == 3;
+    printf("%s: core binding puts %d and %d threads on distinct cpus of nodes 0 and 1\n", ok ? "PASS" : "FAIL", perNode[0], perNode[1]);
+
+    int nodeGroups = topo_place(&topo, 3, "node", place);
+    int nodeOk = nodeGroups == 2 && place[0].node == 0 && place[2].node == 1;
+    for (int i = 0; i < 3; ++i) nodeOk &= place[i].cpu == -1;
+    int noneGroups = topo_place(&topo, 3, "none", place);
+    nodeOk &= noneGroups == 1 && place[2].group == 0 && place[2].node == -1 && place[2].cpu == -1;
+    printf("%s: node binding makes %d groups, none makes %d\n", nodeOk ? "PASS" : "FAIL", nodeGroups, noneGroups);
+    return ok && nodeOk;
+}
+
+
+// a pinned pool on this machine renders what tga_save writes for the same image
+static int check_pool(KerrArgs *args) {
+    Renderer *rptr = render_init(args);
+    int numPx = args->width * args->height;
+    Pixel *image = malloc(numPx * sizeof(Pixel));
+    RenderStats stats = {0};
+    render_span(rptr, 0, numPx, image, &stats);
+    render_free(rptr);
+    ImgOpts opts = {.merge = args->merge};
+    tga_save("/tmp/topo_test.tga", image, args->width, args->height, &opts);
+
+    int ok = 1;
+    const char *binds[] = {"core", "node"};
+    for (int b = 0; b < 2; ++b) {
+        args->bind = (char *) binds[b];
+        TPool *pool = tpool_init(args);
+        tpool_submit(pool, args, "/tmp/topo_test_pool.tga");
+        PoolStats poolStats;
+        tpool_close(pool, &poolStats);
+        free(poolStats.latency);
+
+        int same = !system("cmp -s /tmp/topo_test.tga /tmp/topo_test_pool.tga") && poolStats.tasks == poolStats.numTasks && !strcmp(poolStats.bind, binds[b]);
+        printf("%s: %d threads bound to %s render every tile once (%d groups)\n", same ? "PASS" : "FAIL", args->numThreads, binds[b], poolStats.numGroups);
+        ok &= same;
+    }
+    free(image);
+    return ok;
+}
+
+
+int main() {
+    KerrArgs args = {
+        .pos = {1.1, .1, -8},
+        .dir = {0, 0, 1},
+        .fov = 90,
+        .width = 96,
+        .height = 54,
+        .taskSize = 512,
+        .numThreads = 3,
+        .integrator = "euler",
+        .tol = 1e-5,
+        .tileOrder = "row",
+        .packetWidth = -1,
+        .refine = -1,
+        .escape = 6,
+        .num_steps = 1,
+        .format = "tga",
+        .report = "text",
+        .scene = "schwarz"
+    };
+
+    int ok = check_detect();
+    ok &= check_place();
+    ok &= check_pool(&args);
+
+    system("rm -rf " ROOT);
+    remove("/tmp/topo_test.tga");
+    remove("/tmp/topo_test_pool.tga");
+    return ok ? 0 : 1;
+}
@@ -1,7 +1,10 @@
 for i in $(seq 0 $(($1-1)))
 do
-    ./jgraph -P data/$i.jgr | ps2pdf - | convert -density 300 - -quality 100 data/$i.png
-    rm -f data/$i.jgr
+    # frames rayt -J already converted only have their png left
+    if [ -f data/$i.jgr ]; then
+        ./jgraph -P data/$i.jgr | ps2pdf - | convert -density 300 - -quality 100 data/$i.png
+        rm -f data/$i.jgr
+    fi
 done
 python movie.py $1
-rm -rf data
\ No newline at end of file
+rm -rf data